@@ -0,0 +1,98 @@
+/*
+ * C ABI for handler modules loaded by the server at runtime.
+ *
+ * A module is a shared library exporting http_module_abi() and
+ * http_module_init(), and optionally http_module_fini(). At load time the
+ * server calls http_module_init(), which registers named handlers through the
+ * host table; config routes then refer to them as <module>.<handler>.
+ *
+ * Only plain C types cross this boundary so modules can be built with any
+ * compiler or standard library. Request data is valid for the duration of a
+ * handler call; anything kept longer must be copied.
+ *
+ * Later ABI versions only append fields to the end of the structs below, so
+ * a module built against an older header keeps working on a newer server.
+ *
+ * Handlers run concurrently on several threads and must be thread safe. A
+ * module stays loaded until every route and in-flight request that uses it
+ * has finished, then http_module_fini() runs and the library is closed.
+ */
+#ifndef HTTP_MODULE_H
+#define HTTP_MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever fields are appended below. */
+#define HTTP_MODULE_ABI_VERSION 3
+
+typedef struct http_module_string
+{
+    const char *data;
+    size_t size;
+} http_module_string;
+
+typedef struct http_module_request
+{
+    http_module_string method;
+    http_module_string target;
+    http_module_string body;
+    size_t header_count;
+    const http_module_string *header_names;
+    const http_module_string *header_values;
+
+    /* Since version 2. Milliseconds left before the request's deadline, or -1
+     * if it has none. Pass it on as the timeout of any upstream call. */
+    int64_t deadline_ms;
+} http_module_request;
+
+/* Opaque to modules; filled through the host functions below. */
+typedef struct http_module_response http_module_response;
+typedef struct http_module_registrar http_module_registrar;
+
+/* Return 0 on success; anything else is answered with a 500. */
+typedef int (*http_module_handler)(void *user_data,
+                                   const http_module_request *req,
+                                   http_module_response *res);
+
+typedef struct http_module_host
+{
+    uint32_t abi_version;
+
+    /* Only valid inside http_module_init(). Returns 0 on success. */
+    int (*add_handler)(http_module_registrar *registrar, const char *name,
+                       http_module_handler handler, void *user_data);
+
+    void (*set_status)(http_module_response *res, int status);
+    void (*set_header)(http_module_response *res,
+                       const char *name, size_t name_size,
+                       const char *value, size_t value_size);
+    void (*append_body)(http_module_response *res, const char *data, size_t size);
+
+    void (*log)(const char *message);
+
+    /* Since version 3. Non-zero once the client has disconnected; long
+     * running handlers should poll it and give up early. */
+    int (*is_cancelled)(http_module_response *res);
+} http_module_host;
+
+/* Exported by the module. */
+typedef uint32_t (*http_module_abi_fn)(void);
+typedef int (*http_module_init_fn)(const http_module_host *host,
+                                   http_module_registrar *registrar,
+                                   void **module_state);
+typedef void (*http_module_fini_fn)(void *module_state);
+
+#define HTTP_MODULE_ABI_SYMBOL "http_module_abi"
+#define HTTP_MODULE_INIT_SYMBOL "http_module_init"
+#define HTTP_MODULE_FINI_SYMBOL "http_module_fini"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_MODULE_H */
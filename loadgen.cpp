@@ -0,0 +1,850 @@
+/*g++ -std=c++17 -O2 loadgen.cpp -o loadgen -pthread*/
+// Load generator for the server.
+//
+//   loadgen replay <capture> [--host H] [--port P] [--speed X] [--connections N]
+//                            [--save FILE] [--baseline FILE]
+//   loadgen scenario <file> [--host H] [--port P] [--connections N]
+//                           [--save FILE] [--baseline FILE]
+//
+// replay sends the requests of a capture file (see `capture` in server.conf)
+// in their original order and spacing, divided by --speed (1 = as recorded,
+// 0 = as fast as possible). Latency runs from the moment a request was due,
+// not from when a connection was free to send it, so a slow server cannot
+// hide its queueing delay. --save writes the latencies for a later
+// --baseline comparison.
+//
+// scenario drives synthetic traffic described by a scenario file (see
+// scenarios/): a weighted mix of requests with body size distributions,
+// the share of keep-alive and slow clients, connection churn, and a
+// schedule of stages that hold or ramp the request rate.
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using load_clock = std::chrono::steady_clock;
+
+// ---------------------------
+// CAPTURE FILES
+// ---------------------------
+struct captured_request
+{
+    std::chrono::nanoseconds offset; // since the capture started
+    std::string bytes;
+};
+
+// Magic "HTTPCAP1", then per request: u64 offset ns, u32 size, bytes.
+std::vector<captured_request> read_capture(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    if (!in.read(magic, sizeof magic) || std::memcmp(magic, "HTTPCAP1", 8) != 0)
+        throw std::runtime_error(path + " is not a capture file");
+
+    std::vector<captured_request> requests;
+    for (;;)
+    {
+        std::uint64_t offset;
+        std::uint32_t size;
+        if (!in.read(reinterpret_cast<char *>(&offset), sizeof offset) ||
+            !in.read(reinterpret_cast<char *>(&size), sizeof size))
+            break;
+        captured_request r{std::chrono::nanoseconds(offset), std::string(size, '\0')};
+        if (!in.read(&r.bytes[0], size))
+            break; // truncated tail, e.g. the server was killed mid-write
+        requests.push_back(std::move(r));
+    }
+    return requests;
+}
+
+// ---------------------------
+// HTTP EXCHANGE
+// ---------------------------
+struct endpoint
+{
+    sockaddr_storage addr = {};
+    socklen_t len = 0;
+};
+
+endpoint resolve(const std::string &host, const std::string &port)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found)
+        throw std::runtime_error("cannot resolve " + host + ":" + port);
+    endpoint e;
+    std::memcpy(&e.addr, found->ai_addr, found->ai_addrlen);
+    e.len = found->ai_addrlen;
+    ::freeaddrinfo(found);
+    return e;
+}
+
+// Trickling at bytes_per_s: slices of a tenth of a second's worth (at least
+// a byte, at most `largest`), each followed by `pause`.
+std::size_t pace_slice(std::uint64_t bytes_per_s, std::size_t largest, std::chrono::microseconds &pause)
+{
+    auto slice = std::min<std::uint64_t>(largest, std::max<std::uint64_t>(1, bytes_per_s / 10));
+    pause = std::chrono::microseconds(slice * 1000000 / bytes_per_s);
+    return slice;
+}
+
+// Reads one response: up to Content-Length past the header, or to EOF if
+// there is none. Returns the status code, or 0 on a malformed response.
+// *closes is set when the server announced it will close the connection.
+// A non-zero bytes_per_s reads slowly, see pace_slice.
+int read_response(int fd, bool *closes = nullptr, std::uint64_t bytes_per_s = 0)
+{
+    std::string head;
+    std::size_t header_end = std::string::npos;
+    std::uint64_t body = 0, expected = UINT64_MAX;
+    char buf[16 * 1024];
+    std::chrono::microseconds pause{0};
+    std::size_t slice = bytes_per_s ? pace_slice(bytes_per_s, sizeof buf, pause) : sizeof buf;
+    while (body < expected)
+    {
+        if (!head.empty())
+            std::this_thread::sleep_for(pause);
+        auto n = ::recv(fd, buf, slice, 0);
+        if (n <= 0)
+            break;
+        if (header_end != std::string::npos)
+        {
+            body += static_cast<std::uint64_t>(n);
+            continue;
+        }
+        head.append(buf, static_cast<std::size_t>(n));
+        header_end = head.find("\r\n\r\n");
+        if (header_end == std::string::npos)
+            continue;
+        body = head.size() - header_end - 4;
+        std::string lower(head, 0, header_end + 2);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        auto cl = lower.find("\r\ncontent-length:");
+        if (cl != std::string::npos)
+            expected = std::strtoull(lower.c_str() + cl + 17, nullptr, 10);
+        if (closes)
+            *closes = lower.find("\r\nconnection: close") != std::string::npos;
+    }
+    // "HTTP/1.1 200 ..."
+    if (header_end == std::string::npos || head.compare(0, 5, "HTTP/") != 0 || head.size() < 12)
+        return 0;
+    if (expected != UINT64_MAX && body < expected)
+        return 0; // cut short
+    return std::atoi(head.c_str() + 9);
+}
+
+bool send_all(int fd, const char *data, std::size_t size)
+{
+    while (size > 0)
+    {
+        auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Returns a connected socket, or -1. A receive buffer size, if given, is set
+// before connecting so it bounds the window the server sees.
+int open_connection(const endpoint &e, int receive_buffer = 0)
+{
+    int fd = ::socket(e.addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && receive_buffer > 0)
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof receive_buffer);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr *>(&e.addr), e.len) != 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// One request on its own connection. Returns the status code, or 0 if the
+// exchange failed.
+int exchange(const endpoint &e, const std::string &request)
+{
+    int fd = open_connection(e);
+    if (fd < 0)
+        return 0;
+    int status = 0;
+    if (send_all(fd, request.data(), request.size()))
+        status = read_response(fd);
+    ::close(fd);
+    return status;
+}
+
+// ---------------------------
+// LATENCY REPORTS
+// ---------------------------
+struct run_result
+{
+    std::vector<std::int64_t> latencies_us; // successful requests only
+    std::size_t errors = 0;                 // failed exchanges and 5xx
+    double seconds = 0;
+};
+
+std::int64_t percentile(const std::vector<std::int64_t> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    auto i = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+void print_summary(const std::string &label, std::vector<std::int64_t> latencies, std::size_t errors,
+                   int width = 10)
+{
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::left << std::setw(width) << label << std::right << std::fixed << std::setprecision(3)
+              << " n=" << latencies.size() << " errors=" << errors;
+    static const std::pair<const char *, double> points[] = {{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p99.9", 0.999}};
+    for (auto &p : points)
+        std::cout << " " << p.first << "=" << percentile(latencies, p.second) / 1000.0 << "ms";
+    std::cout << " max=" << (latencies.empty() ? 0 : latencies.back()) / 1000.0 << "ms\n";
+}
+
+// Format of --save / --baseline: "errors N" then one latency (us) per line.
+void save_latencies(const std::string &path, const run_result &r)
+{
+    std::ofstream out(path);
+    out << "errors " << r.errors << "\n";
+    for (auto l : r.latencies_us)
+        out << l << "\n";
+}
+
+run_result load_latencies(const std::string &path)
+{
+    std::ifstream in(path);
+    run_result r;
+    std::string word;
+    if (!(in >> word >> r.errors) || word != "errors")
+        throw std::runtime_error(path + " is not a saved latency file");
+    std::int64_t l;
+    while (in >> l)
+        r.latencies_us.push_back(l);
+    return r;
+}
+
+void report(const run_result &r, const std::string &save, const std::string &baseline)
+{
+    std::cout << "sent " << r.latencies_us.size() + r.errors << " requests in " << std::setprecision(2)
+              << std::fixed << r.seconds << "s (" << (r.latencies_us.size() + r.errors) / r.seconds << "/s)\n";
+    if (!baseline.empty())
+    {
+        auto base = load_latencies(baseline);
+        print_summary("baseline", base.latencies_us, base.errors);
+    }
+    print_summary("this run", r.latencies_us, r.errors);
+    if (!save.empty())
+        save_latencies(save, r);
+}
+
+// ---------------------------
+// REPLAY
+// ---------------------------
+run_result replay(const std::vector<captured_request> &requests, const endpoint &e, double speed,
+                  int connections)
+{
+    run_result result;
+    std::mutex mutex;
+    std::atomic<std::size_t> next{0};
+    // A little slack so the first requests are not late before threads start.
+    auto start = load_clock::now() + (speed > 0 ? std::chrono::milliseconds(10) : std::chrono::milliseconds(0));
+
+    // Each worker is one client connection at a time; requests are claimed
+    // in capture order so the replay is the same on every run.
+    auto worker = [&]
+    {
+        std::vector<std::int64_t> mine;
+        std::size_t errors = 0;
+        for (;;)
+        {
+            auto i = next.fetch_add(1);
+            if (i >= requests.size())
+                break;
+            auto due = load_clock::now();
+            if (speed > 0)
+            {
+                due = start + std::chrono::duration_cast<load_clock::duration>(requests[i].offset / speed);
+                std::this_thread::sleep_until(due);
+            }
+            int status = exchange(e, requests[i].bytes);
+            auto took = std::chrono::duration_cast<std::chrono::microseconds>(load_clock::now() - due);
+            if (status == 0 || status >= 500)
+                errors++;
+            else
+                mine.push_back(took.count());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        result.latencies_us.insert(result.latencies_us.end(), mine.begin(), mine.end());
+        result.errors += errors;
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < connections; i++)
+        threads.emplace_back(worker);
+    for (auto &t : threads)
+        t.join();
+    result.seconds = std::chrono::duration<double>(load_clock::now() - start).count();
+    return result;
+}
+
+// ---------------------------
+// SCENARIOS
+// ---------------------------
+// Size of a request body, drawn per request.
+struct size_distribution
+{
+    enum class kind
+    {
+        none,
+        fixed,
+        uniform,
+        exponential
+    };
+    kind type = kind::none;
+    std::uint64_t a = 0, b = 0; // fixed: a; uniform: a..b; exponential: mean a
+
+    std::uint64_t draw(std::mt19937_64 &rng) const
+    {
+        switch (type)
+        {
+        case kind::fixed:
+            return a;
+        case kind::uniform:
+            return std::uniform_int_distribution<std::uint64_t>(a, b)(rng);
+        case kind::exponential:
+            return static_cast<std::uint64_t>(std::exponential_distribution<double>(1.0 / a)(rng));
+        default:
+            return 0;
+        }
+    }
+};
+
+struct request_kind
+{
+    double weight = 1;
+    std::string method, path, name;
+    size_distribution body;
+    std::string headers; // rendered "Name: value\r\n" lines
+
+    std::string label() const { return name.empty() ? method + " " + path : name; }
+};
+
+// One step of the schedule. Open-loop stages send at a rate that moves
+// linearly from rate_from to rate_to; closed-loop stages keep every
+// connection busy instead.
+struct stage
+{
+    double seconds = 0;
+    double rate_from = 0, rate_to = 0; // requests per second
+    bool closed_loop = false;
+};
+
+struct scenario
+{
+    std::vector<request_kind> requests;
+    std::vector<stage> stages;
+    int connections = 16;
+    double keepalive = 1;                      // share of connections reused across requests
+    std::uint64_t requests_per_connection = 0; // reconnect after this many, 0 = never
+    double slow_share = 0;                     // share of connections that trickle requests
+    std::uint64_t slow_bytes_per_s = 100;
+    double slow_reader_share = 0; // share of connections that read responses slowly
+    std::uint64_t slow_reader_bytes_per_s = 100;
+    std::uint64_t seed = 1;
+};
+
+// "64k", "2m" or a plain byte count.
+std::uint64_t parse_size(const std::string &text)
+{
+    std::size_t used = 0;
+    auto n = std::stoull(text, &used);
+    auto unit = text.substr(used);
+    if (unit == "k" || unit == "K")
+        return n * 1024;
+    if (unit == "m" || unit == "M")
+        return n * 1024 * 1024;
+    if (!unit.empty())
+        throw std::runtime_error("bad size " + text);
+    return n;
+}
+
+// "30s", "500ms" or a plain number of seconds.
+double parse_seconds(const std::string &text)
+{
+    std::size_t used = 0;
+    auto n = std::stod(text, &used);
+    auto unit = text.substr(used);
+    if (unit == "ms")
+        return n / 1000;
+    if (!unit.empty() && unit != "s")
+        throw std::runtime_error("bad duration " + text);
+    return n;
+}
+
+size_distribution parse_distribution(const std::string &text)
+{
+    size_distribution d;
+    auto colon = text.find(':');
+    auto name = text.substr(0, colon);
+    auto args = colon == std::string::npos ? std::string() : text.substr(colon + 1);
+    if (name == "fixed")
+    {
+        d.type = size_distribution::kind::fixed;
+        d.a = parse_size(args);
+    }
+    else if (name == "uniform" && args.find('-') != std::string::npos)
+    {
+        d.type = size_distribution::kind::uniform;
+        d.a = parse_size(args.substr(0, args.find('-')));
+        d.b = parse_size(args.substr(args.find('-') + 1));
+        if (d.b < d.a)
+            throw std::runtime_error("empty range " + args);
+    }
+    else if (name == "exp")
+    {
+        d.type = size_distribution::kind::exponential;
+        d.a = std::max<std::uint64_t>(1, parse_size(args));
+    }
+    else
+        throw std::runtime_error("unknown body distribution " + text + " (fixed:N, uniform:A-B, exp:MEAN)");
+    return d;
+}
+
+// Splits "key=value"; returns false for a bare word.
+bool split_option(const std::string &word, std::string &key, std::string &value)
+{
+    auto eq = word.find('=');
+    if (eq == std::string::npos)
+        return false;
+    key = word.substr(0, eq);
+    value = word.substr(eq + 1);
+    return true;
+}
+
+// Scenario files use the same shape as server.conf: one directive per line,
+// '#' starts a comment.
+scenario load_scenario(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("cannot open " + path);
+
+    scenario sc;
+    std::string line;
+    int number = 0;
+    while (std::getline(in, line))
+    {
+        number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::vector<std::string> w;
+        for (std::string word; words >> word;)
+            w.push_back(word);
+        if (w.empty())
+            continue;
+
+        try
+        {
+            std::string key, value;
+            if (w[0] == "request" && w.size() >= 4)
+            {
+                request_kind r;
+                r.weight = std::stod(w[1]);
+                r.method = w[2];
+                r.path = w[3];
+                for (std::size_t i = 4; i < w.size(); i++)
+                {
+                    if (!split_option(w[i], key, value))
+                        throw std::runtime_error("unexpected " + w[i]);
+                    if (key == "name")
+                        r.name = value;
+                    else if (key == "body")
+                        r.body = parse_distribution(value);
+                    else if (key == "header" && value.find(':') != std::string::npos)
+                        r.headers += value.substr(0, value.find(':')) + ": " + value.substr(value.find(':') + 1) + "\r\n";
+                    else if (key == "pad_headers" && value.find(':') != std::string::npos)
+                    {
+                        // pad_headers=COUNT:SIZE adds COUNT headers of SIZE bytes each.
+                        auto count = std::stoul(value.substr(0, value.find(':')));
+                        auto size = parse_size(value.substr(value.find(':') + 1));
+                        for (unsigned long h = 0; h < count; h++)
+                            r.headers += "X-Pad-" + std::to_string(h) + ": " + std::string(size, 'p') + "\r\n";
+                    }
+                    else
+                        throw std::runtime_error("unknown request option " + w[i]);
+                }
+                if (r.weight <= 0)
+                    throw std::runtime_error("request weight must be positive");
+                sc.requests.push_back(std::move(r));
+            }
+            else if (w[0] == "stage" && w.size() == 3 && split_option(w[2], key, value) && key == "rate")
+            {
+                stage st;
+                st.seconds = parse_seconds(w[1]);
+                auto dash = value.find('-');
+                if (value == "max")
+                    st.closed_loop = true;
+                else if (dash != std::string::npos)
+                {
+                    st.rate_from = std::stod(value.substr(0, dash));
+                    st.rate_to = std::stod(value.substr(dash + 1));
+                }
+                else
+                    st.rate_from = st.rate_to = std::stod(value);
+                if (st.seconds <= 0)
+                    throw std::runtime_error("stage needs a positive duration");
+                sc.stages.push_back(st);
+            }
+            else if (w[0] == "connections" && w.size() == 2)
+                sc.connections = std::max(1, std::stoi(w[1]));
+            else if (w[0] == "keepalive" && w.size() == 2)
+                sc.keepalive = std::stod(w[1]);
+            else if (w[0] == "requests_per_connection" && w.size() == 2)
+                sc.requests_per_connection = std::stoull(w[1]);
+            else if ((w[0] == "slow_clients" || w[0] == "slow_readers") && (w.size() == 2 || w.size() == 3))
+            {
+                bool readers = w[0] == "slow_readers";
+                (readers ? sc.slow_reader_share : sc.slow_share) = std::stod(w[1]);
+                if (w.size() == 3)
+                {
+                    if (!split_option(w[2], key, value) || key != "bytes_per_s")
+                        throw std::runtime_error("unexpected " + w[2]);
+                    (readers ? sc.slow_reader_bytes_per_s : sc.slow_bytes_per_s) =
+                        std::max<std::uint64_t>(1, parse_size(value));
+                }
+            }
+            else if (w[0] == "seed" && w.size() == 2)
+                sc.seed = std::stoull(w[1]);
+            else
+                throw std::runtime_error("unknown directive " + w[0]);
+        }
+        catch (std::invalid_argument &)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(number) + ": bad number");
+        }
+        catch (std::out_of_range &)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(number) + ": number out of range");
+        }
+        catch (std::runtime_error &e)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(number) + ": " + e.what());
+        }
+    }
+    if (sc.requests.empty())
+        throw std::runtime_error(path + ": no request lines");
+    if (sc.stages.empty())
+        throw std::runtime_error(path + ": no stage lines");
+    return sc;
+}
+
+// Hands out the due time and kind of every request of a run, shared by all
+// connections. Kinds are drawn from one seeded generator so a scenario sends
+// the same mix on every run.
+class arrivals
+{
+    std::mutex mutex_;
+    const scenario &sc_;
+    std::discrete_distribution<std::size_t> pick_;
+    std::mt19937_64 rng_;
+    std::size_t stage_ = 0;
+    load_clock::time_point stage_start_;
+    double next_ = 0; // seconds into the stage of the next open-loop request
+
+public:
+    arrivals(const scenario &sc, load_clock::time_point start) : sc_(sc), rng_(sc.seed), stage_start_(start)
+    {
+        std::vector<double> weights;
+        for (auto &r : sc.requests)
+            weights.push_back(r.weight);
+        pick_ = std::discrete_distribution<std::size_t>(weights.begin(), weights.end());
+    }
+
+    // False once the last stage is over.
+    bool next(load_clock::time_point &due, std::size_t &kind)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (stage_ < sc_.stages.size())
+        {
+            auto &st = sc_.stages[stage_];
+            auto length = std::chrono::duration_cast<load_clock::duration>(std::chrono::duration<double>(st.seconds));
+            if (st.closed_loop)
+            {
+                due = load_clock::now();
+                if (due < stage_start_ + length)
+                {
+                    kind = pick_(rng_);
+                    return true;
+                }
+            }
+            else if (next_ < st.seconds)
+            {
+                due = stage_start_ + std::chrono::duration_cast<load_clock::duration>(std::chrono::duration<double>(next_));
+                kind = pick_(rng_);
+                // A ramp starting at 0 would never send; floor the rate at 1/s.
+                double rate = st.rate_from + (st.rate_to - st.rate_from) * next_ / st.seconds;
+                next_ += 1 / std::max(rate, 1.0);
+                return true;
+            }
+            stage_++;
+            stage_start_ += length;
+            next_ = 0;
+        }
+        return false;
+    }
+};
+
+// One client connection of a scenario. Whether it is kept alive, trickles
+// its requests or reads slowly is decided each time it connects.
+struct client
+{
+    int fd = -1;
+    bool keep_alive = false, slow = false, slow_reader = false;
+    std::uint64_t served = 0;
+
+    ~client() { close(); }
+
+    void close()
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+};
+
+bool send_slowly(int fd, const std::string &data, std::uint64_t bytes_per_s)
+{
+    std::chrono::microseconds pause;
+    std::size_t slice = pace_slice(bytes_per_s, data.size(), pause);
+    for (std::size_t sent = 0; sent < data.size(); sent += slice)
+    {
+        if (sent > 0)
+            std::this_thread::sleep_for(pause);
+        if (!send_all(fd, data.data() + sent, std::min(slice, data.size() - sent)))
+            return false;
+    }
+    return true;
+}
+
+// Returns the status code, or 0 if the exchange failed. A kept-alive
+// connection the server has meanwhile closed is retried once on a new one.
+int scenario_exchange(client &c, const endpoint &e, const scenario &sc, const request_kind &r,
+                      std::mt19937_64 &rng)
+{
+    std::uniform_real_distribution<double> share(0, 1);
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        bool reused = c.fd >= 0;
+        if (!reused)
+        {
+            c.keep_alive = share(rng) < sc.keepalive;
+            c.slow = share(rng) < sc.slow_share;
+            c.slow_reader = share(rng) < sc.slow_reader_share;
+            c.served = 0;
+            // A small window keeps a slow reader from sinking the response
+            // into its socket buffer at once.
+            c.fd = open_connection(e, c.slow_reader ? 4096 : 0);
+            if (c.fd < 0)
+                return 0;
+        }
+
+        auto body = r.body.draw(rng);
+        std::string request = r.method + " " + r.path + " HTTP/1.1\r\nHost: loadgen\r\n" + r.headers;
+        if (!c.keep_alive)
+            request += "Connection: close\r\n";
+        if (r.body.type != size_distribution::kind::none)
+            request += "Content-Length: " + std::to_string(body) + "\r\n";
+        request += "\r\n";
+        request.append(body, 'x');
+
+        bool sent = c.slow ? send_slowly(c.fd, request, sc.slow_bytes_per_s)
+                           : send_all(c.fd, request.data(), request.size());
+        bool closes = false;
+        int status = sent ? read_response(c.fd, &closes, c.slow_reader ? sc.slow_reader_bytes_per_s : 0) : 0;
+        if (status == 0)
+        {
+            c.close();
+            if (reused)
+                continue;
+            return 0;
+        }
+        c.served++;
+        if (!c.keep_alive || closes || (sc.requests_per_connection && c.served >= sc.requests_per_connection))
+            c.close();
+        return status;
+    }
+    return 0;
+}
+
+struct scenario_result
+{
+    run_result total;
+    std::vector<run_result> per_kind;
+    std::map<int, std::size_t> statuses; // 0 counts failed exchanges
+};
+
+scenario_result run_scenario(const scenario &sc, const endpoint &e)
+{
+    scenario_result result;
+    result.per_kind.resize(sc.requests.size());
+    std::mutex mutex;
+    auto start = load_clock::now() + std::chrono::milliseconds(10);
+    arrivals schedule(sc, start);
+
+    auto worker = [&](int index)
+    {
+        std::mt19937_64 rng(sc.seed * 7919 + static_cast<std::uint64_t>(index));
+        std::vector<run_result> mine(sc.requests.size());
+        std::map<int, std::size_t> statuses;
+        client c;
+        load_clock::time_point due;
+        std::size_t kind;
+        while (schedule.next(due, kind))
+        {
+            std::this_thread::sleep_until(due);
+            int status = scenario_exchange(c, e, sc, sc.requests[kind], rng);
+            auto took = std::chrono::duration_cast<std::chrono::microseconds>(load_clock::now() - due);
+            statuses[status]++;
+            if (status == 0 || status >= 500)
+                mine[kind].errors++;
+            else
+                mine[kind].latencies_us.push_back(took.count());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::size_t k = 0; k < mine.size(); k++)
+        {
+            auto &into = result.per_kind[k];
+            into.latencies_us.insert(into.latencies_us.end(), mine[k].latencies_us.begin(), mine[k].latencies_us.end());
+            into.errors += mine[k].errors;
+        }
+        for (auto &s : statuses)
+            result.statuses[s.first] += s.second;
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < sc.connections; i++)
+        threads.emplace_back(worker, i);
+    for (auto &t : threads)
+        t.join();
+
+    result.total.seconds = std::chrono::duration<double>(load_clock::now() - start).count();
+    for (auto &k : result.per_kind)
+    {
+        result.total.latencies_us.insert(result.total.latencies_us.end(), k.latencies_us.begin(), k.latencies_us.end());
+        result.total.errors += k.errors;
+    }
+    return result;
+}
+
+void report_scenario(const scenario &sc, const scenario_result &r, const std::string &save,
+                     const std::string &baseline)
+{
+    report(r.total, save, baseline);
+    int width = 10;
+    for (auto &k : sc.requests)
+        width = std::max(width, static_cast<int>(k.label().size()));
+    for (std::size_t k = 0; k < sc.requests.size(); k++)
+        print_summary(sc.requests[k].label(), r.per_kind[k].latencies_us, r.per_kind[k].errors, width);
+    std::cout << "statuses:";
+    for (auto &s : r.statuses)
+        std::cout << " " << (s.first ? std::to_string(s.first) : std::string("failed")) << "=" << s.second;
+    std::cout << "\n";
+}
+
+int usage()
+{
+    std::cerr << "usage: loadgen replay <capture> [--host H] [--port P] [--speed X] [--connections N]\n"
+                 "                                [--save FILE] [--baseline FILE]\n"
+                 "       loadgen scenario <file> [--host H] [--port P] [--connections N]\n"
+                 "                               [--save FILE] [--baseline FILE]\n";
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string mode = argc >= 3 ? argv[1] : "";
+    if (mode != "replay" && mode != "scenario")
+        return usage();
+
+    std::string host = "127.0.0.1", port = "8090", save, baseline;
+    double speed = 1;
+    int connections = 0; // replay: 64, scenario: as the file says
+    for (int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return usage();
+        std::string value = argv[++i];
+        if (arg == "--host")
+            host = value;
+        else if (arg == "--port")
+            port = value;
+        else if (arg == "--speed" && mode == "replay")
+            speed = std::stod(value);
+        else if (arg == "--connections")
+            connections = std::max(1, std::stoi(value));
+        else if (arg == "--save")
+            save = value;
+        else if (arg == "--baseline")
+            baseline = value;
+        else
+            return usage();
+    }
+
+    try
+    {
+        if (mode == "scenario")
+        {
+            auto sc = load_scenario(argv[2]);
+            if (connections > 0)
+                sc.connections = connections;
+            double seconds = 0;
+            for (auto &st : sc.stages)
+                seconds += st.seconds;
+            std::cout << "running " << argv[2] << ": " << sc.requests.size() << " request kinds, "
+                      << sc.stages.size() << " stages over " << seconds << "s, " << sc.connections
+                      << " connections\n";
+            report_scenario(sc, run_scenario(sc, resolve(host, port)), save, baseline);
+            return 0;
+        }
+
+        if (connections == 0)
+            connections = 64;
+        auto requests = read_capture(argv[2]);
+        std::cout << "replaying " << requests.size() << " requests";
+        if (speed > 0)
+            std::cout << " at " << speed << "x";
+        else
+            std::cout << " at full speed";
+        std::cout << " over " << connections << " connections\n";
+        report(replay(requests, resolve(host, port), speed, connections), save, baseline);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Fatal Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -1,99 +1,5544 @@
-/*g++ -std=c++17 main.cpp -o server*/
+/*g++ -std=c++17 -fno-omit-frame-pointer -rdynamic main.cpp -o server -pthread -ldl -lz*/
 #include <boost/asio.hpp>
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <linux/errqueue.h>
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <thread>
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <iostream>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include "http_module.h"
+#include "metrics_shm.h"
 
 using tcp = boost::asio::ip::tcp;
 namespace http = boost::beast::http;
 
 // ---------------------------
-// ROUTER
+// TSC CLOCK
+// ---------------------------
+// Timestamps for instrumentation: latency histograms and busy-poll accounting
+// take several per request, and rdtsc costs a fraction of clock_gettime.
+// tsc_clock is used only when the TSC is invariant and the kernel itself
+// trusts it as its clocksource; otherwise it is steady_clock. Each thread
+// pairs a TSC reading with steady_clock and converts from there, re-anchoring
+// every 100 ms so calibration error cannot accumulate and readings stay on
+// steady_clock's epoch across threads. Deadlines keep using deadline_clock.
+struct tsc_clock
+{
+    using rep = std::int64_t;
+    using period = std::nano;
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<tsc_clock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        auto &c = calibration();
+        if (c.ns_per_tick > 0)
+        {
+            thread_local anchor a = take_anchor();
+            std::uint64_t ticks = __rdtsc();
+            // Unsigned: a TSC behind the anchor (another socket) wraps to huge.
+            if (ticks - a.ticks > c.reanchor_ticks)
+            {
+                a = take_anchor();
+                ticks = a.ticks;
+            }
+            return time_point(duration(a.ns + static_cast<rep>((ticks - a.ticks) * c.ns_per_tick)));
+        }
+#endif
+        return time_point(steady_ns());
+    }
+
+    // "tsc" or "steady"; the first call calibrates (about 20 ms).
+    static const char *source()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (calibration().ns_per_tick > 0)
+            return "tsc";
+#endif
+        return "steady";
+    }
+
+private:
+    static duration steady_ns()
+    {
+        return std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch());
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    struct anchor
+    {
+        std::uint64_t ticks;
+        rep ns;
+    };
+
+    struct calibrated
+    {
+        double ns_per_tick = 0; // 0 = TSC not usable
+        std::uint64_t reanchor_ticks = 0;
+    };
+
+    static anchor take_anchor()
+    {
+        auto ns = steady_ns().count();
+        return anchor{__rdtsc(), ns};
+    }
+
+    static const calibrated &calibration()
+    {
+        static const calibrated c = []
+        {
+            calibrated result;
+            unsigned eax, ebx, ecx, edx;
+            bool invariant = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+            std::string source;
+            std::ifstream("/sys/devices/system/clocksource/clocksource0/current_clocksource") >> source;
+            if (!invariant || source != "tsc")
+                return result;
+
+            auto t0 = steady_ns();
+            std::uint64_t c0 = __rdtsc();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            auto t1 = steady_ns();
+            std::uint64_t c1 = __rdtsc();
+            if (c1 <= c0)
+                return result;
+            result.ns_per_tick = static_cast<double>((t1 - t0).count()) / static_cast<double>(c1 - c0);
+            result.reanchor_ticks = static_cast<std::uint64_t>(100e6 / result.ns_per_tick);
+            return result;
+        }();
+        return c;
+    }
+#endif
+};
+
+// ---------------------------
+// LOCK PROFILING
+// ---------------------------
+// Every mutex inside the server is a profiled_mutex named after its lock
+// site ("response_cache", "exec_pool", ...). Instances of a site share one
+// lock_site that counts acquisitions and waits and keeps log2 histograms of
+// wait and hold times; the `locks` handler renders them. Profiling is off
+// unless `lock_profiling on` is set, and then a lock is a plain
+// std::mutex. When on, an uncontended acquisition costs a try_lock and two
+// clock reads, and only a failed try_lock is timed as a wait. Each thread
+// counts into its own shard of the site, so profiling adds no shared cache
+// line to the lock.
+std::atomic<bool> lock_profiling{false};
+
+struct lock_site
+{
+    static constexpr int buckets = 40; // bucket i counts [2^i, 2^(i+1)) ns
+    static constexpr unsigned shards = 64; // threads past this share shards
+
+    struct counters
+    {
+        std::uint64_t acquired = 0, contended = 0, wait_ns = 0, hold_ns = 0, hold_max_ns = 0;
+        std::array<std::uint64_t, buckets> wait{}, hold{};
+    };
+
+    struct alignas(64) shard
+    {
+        std::atomic<std::uint64_t> acquired{0}, contended{0};
+        std::atomic<std::uint64_t> wait_ns{0}, hold_ns{0}, hold_max_ns{0};
+        std::array<std::atomic<std::uint64_t>, buckets> wait{}, hold{};
+    };
+
+    const char *name;
+    std::array<shard, shards> per_thread;
+
+    explicit lock_site(const char *n) : name(n) {}
+
+    static int bucket(std::int64_t ns)
+    {
+        return ns <= 1 ? 0 : std::min(buckets - 1, 63 - __builtin_clzll(static_cast<std::uint64_t>(ns)));
+    }
+
+    shard &local()
+    {
+        static std::atomic<unsigned> next{0};
+        static thread_local unsigned index = next.fetch_add(1, std::memory_order_relaxed) % shards;
+        return per_thread[index];
+    }
+
+    void acquired()
+    {
+        local().acquired.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void waited(std::int64_t ns)
+    {
+        auto &s = local();
+        s.contended.fetch_add(1, std::memory_order_relaxed);
+        s.wait_ns.fetch_add(ns, std::memory_order_relaxed);
+        s.wait[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void held(std::int64_t ns)
+    {
+        auto &s = local();
+        s.hold_ns.fetch_add(ns, std::memory_order_relaxed);
+        s.hold[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        if (static_cast<std::uint64_t>(ns) > s.hold_max_ns.load(std::memory_order_relaxed))
+            s.hold_max_ns.store(ns, std::memory_order_relaxed); // a shared shard may lose a race; rare
+    }
+
+    counters sum() const
+    {
+        counters c;
+        for (auto &s : per_thread)
+        {
+            c.acquired += s.acquired.load(std::memory_order_relaxed);
+            c.contended += s.contended.load(std::memory_order_relaxed);
+            c.wait_ns += s.wait_ns.load(std::memory_order_relaxed);
+            c.hold_ns += s.hold_ns.load(std::memory_order_relaxed);
+            c.hold_max_ns = std::max<std::uint64_t>(c.hold_max_ns, s.hold_max_ns.load(std::memory_order_relaxed));
+            for (int i = 0; i < buckets; i++)
+            {
+                c.wait[i] += s.wait[i].load(std::memory_order_relaxed);
+                c.hold[i] += s.hold[i].load(std::memory_order_relaxed);
+            }
+        }
+        return c;
+    }
+
+    void reset()
+    {
+        for (auto &s : per_thread)
+        {
+            s.acquired = s.contended = s.wait_ns = s.hold_ns = s.hold_max_ns = 0;
+            for (int i = 0; i < buckets; i++)
+                s.wait[i] = s.hold[i] = 0;
+        }
+    }
+};
+
+class lock_registry
+{
+    std::mutex mutex_; // only taken when a site is first used or rendered
+    std::deque<lock_site> sites_; // deque: sites never move
+
+public:
+    static lock_registry &instance()
+    {
+        static lock_registry registry;
+        return registry;
+    }
+
+    lock_site &site(const char *name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &s : sites_)
+            if (std::strcmp(s.name, name) == 0)
+                return s;
+        return sites_.emplace_back(name);
+    }
+
+    // A table of every site, most total wait first, then its histograms.
+    // `reset` zeroes the counters afterwards so the next call covers a
+    // fresh interval.
+    std::string render(bool reset)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::pair<const char *, lock_site::counters>> order;
+        for (auto &s : sites_)
+            order.emplace_back(s.name, s.sum());
+        std::sort(order.begin(), order.end(), [](const auto &a, const auto &b)
+                  { return a.second.wait_ns > b.second.wait_ns; });
+
+        // Upper bound of the bucket holding the p-th observation.
+        auto quantile = [](const std::array<std::uint64_t, lock_site::buckets> &h, double p)
+        {
+            std::uint64_t total = 0, seen = 0;
+            for (auto b : h)
+                total += b;
+            for (int i = 0; i < lock_site::buckets; i++)
+            {
+                seen += h[i];
+                if (total && seen >= p * total)
+                    return std::ldexp(1.0, i + 1);
+            }
+            return 0.0;
+        };
+        auto us = [](double ns)
+        {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(ns < 10000 ? 2 : 0) << ns / 1000 << "us";
+            return out.str();
+        };
+
+        std::ostringstream out;
+        if (!lock_profiling.load())
+            out << "lock profiling is off; set `lock_profiling on` in the config\n\n";
+        out << std::left << std::setw(20) << "site" << std::right << std::setw(12) << "acquired" << std::setw(11)
+            << "contended" << std::setw(14) << "wait_total" << std::setw(11) << "wait_p99" << std::setw(14)
+            << "hold_total" << std::setw(11) << "hold_p99" << std::setw(13) << "hold_max"
+            << "\n";
+        for (auto &[name, c] : order)
+        {
+            std::ostringstream share;
+            share << std::fixed << std::setprecision(2) << (c.acquired ? 100.0 * c.contended / c.acquired : 0) << "%";
+            out << std::left << std::setw(20) << name << std::right << std::setw(12) << c.acquired << std::setw(11)
+                << share.str() << std::setw(14) << us(c.wait_ns) << std::setw(11) << us(quantile(c.wait, 0.99))
+                << std::setw(14) << us(c.hold_ns) << std::setw(11)
+                << us(std::min<double>(quantile(c.hold, 0.99), c.hold_max_ns)) << std::setw(13) << us(c.hold_max_ns)
+                << "\n";
+        }
+
+        // "<bound=count" for every non-empty bucket of sites that were used.
+        for (auto &[name, c] : order)
+        {
+            if (!c.acquired)
+                continue;
+            out << "\n";
+            for (auto kind : {"wait", "hold"})
+            {
+                auto &h = std::strcmp(kind, "wait") == 0 ? c.wait : c.hold;
+                std::ostringstream line;
+                for (int i = 0; i < lock_site::buckets; i++)
+                    if (h[i])
+                        line << " <" << us(std::ldexp(1.0, i + 1)) << "=" << h[i];
+                if (!line.str().empty())
+                    out << name << " " << kind << ":" << line.str() << "\n";
+            }
+        }
+
+        if (reset)
+            for (auto &s : sites_)
+                s.reset();
+        return out.str();
+    }
+};
+
+// Drop-in for std::mutex (Lockable) that reports to its lock_site. Use
+// std::condition_variable_any to wait on one.
+class profiled_mutex
+{
+    std::mutex mutex_;
+    lock_site *site_;
+    bool timed_ = false;               // this hold is being profiled; written only by the holder
+    tsc_clock::time_point held_since_; // written only by the holder
+
+public:
+    // Looking a site up by name takes the registry lock; mutexes created per
+    // request pass a site they looked up once instead.
+    explicit profiled_mutex(const char *site) : site_(&lock_registry::instance().site(site)) {}
+    explicit profiled_mutex(lock_site &site) : site_(&site) {}
+
+    profiled_mutex(const profiled_mutex &) = delete;
+    profiled_mutex &operator=(const profiled_mutex &) = delete;
+
+    void lock()
+    {
+        if (!lock_profiling.load(std::memory_order_relaxed))
+        {
+            mutex_.lock();
+            timed_ = false;
+            return;
+        }
+        if (mutex_.try_lock())
+            held_since_ = tsc_clock::now();
+        else
+        {
+            auto start = tsc_clock::now();
+            mutex_.lock();
+            held_since_ = tsc_clock::now();
+            site_->waited((held_since_ - start).count());
+        }
+        timed_ = true;
+        site_->acquired();
+    }
+
+    bool try_lock()
+    {
+        if (!mutex_.try_lock())
+            return false;
+        timed_ = lock_profiling.load(std::memory_order_relaxed);
+        if (timed_)
+        {
+            held_since_ = tsc_clock::now();
+            site_->acquired();
+        }
+        return true;
+    }
+
+    void unlock()
+    {
+        if (!timed_)
+            return mutex_.unlock();
+        auto held = tsc_clock::now() - held_since_;
+        mutex_.unlock();
+        site_->held(held.count());
+    }
+};
+
+// ---------------------------
+// RCU (EPOCH BASED RECLAMATION)
+// ---------------------------
+// Readers pin the global epoch in a per-thread slot for the duration of a
+// read_guard and never take a lock. Writers publish a new object with an
+// atomic pointer swap, advance the epoch, and free a retired object only once
+// no reader is still pinned to an epoch older than its retirement.
+class rcu_domain
+{
+    struct reader_slot
+    {
+        std::atomic<std::uint64_t> epoch{0}; // 0 = not inside a read section
+        std::atomic<bool> in_use{false};
+        reader_slot *next = nullptr;
+    };
+
+    // Hands a slot to each thread on first use and gives it back on thread
+    // exit so short-lived threads do not grow the slot list forever.
+    struct thread_state
+    {
+        reader_slot *slot = nullptr;
+        int depth = 0;
+
+        ~thread_state()
+        {
+            if (slot)
+                slot->in_use.store(false, std::memory_order_release);
+        }
+    };
+
+    std::atomic<std::uint64_t> epoch_{1};
+    std::atomic<reader_slot *> slots_{nullptr};
+
+    static thread_state &local()
+    {
+        static thread_local thread_state state;
+        return state;
+    }
+
+    reader_slot *acquire_slot()
+    {
+        for (auto *s = slots_.load(std::memory_order_acquire); s; s = s->next)
+        {
+            bool expected = false;
+            if (s->in_use.compare_exchange_strong(expected, true))
+                return s;
+        }
+
+        // Slots are never freed; the list only grows to the peak thread count.
+        auto *s = new reader_slot;
+        s->in_use.store(true, std::memory_order_relaxed);
+        s->next = slots_.load(std::memory_order_relaxed);
+        while (!slots_.compare_exchange_weak(s->next, s))
+        {
+        }
+        return s;
+    }
+
+public:
+    static rcu_domain &instance()
+    {
+        static rcu_domain domain;
+        return domain;
+    }
+
+    class read_guard
+    {
+    public:
+        read_guard()
+        {
+            auto &d = instance();
+            auto &state = local();
+            if (state.depth++ == 0)
+            {
+                if (!state.slot)
+                    state.slot = d.acquire_slot();
+                state.slot->epoch.store(d.epoch_.load());
+            }
+        }
+
+        ~read_guard()
+        {
+            auto &state = local();
+            if (--state.depth == 0)
+                state.slot->epoch.store(0, std::memory_order_release);
+        }
+
+        read_guard(const read_guard &) = delete;
+        read_guard &operator=(const read_guard &) = delete;
+    };
+
+    // Returns the epoch that objects unlinked before this call retire in.
+    std::uint64_t advance()
+    {
+        return epoch_.fetch_add(1) + 1;
+    }
+
+    // True once every reader that could have seen an object retired in
+    // `epoch` has left its read section.
+    bool quiescent(std::uint64_t epoch) const
+    {
+        for (auto *s = slots_.load(std::memory_order_acquire); s; s = s->next)
+        {
+            auto pinned = s->epoch.load();
+            if (pinned != 0 && pinned < epoch)
+                return false;
+        }
+        return true;
+    }
+};
+
+template <class T>
+class rcu_ptr
+{
+    std::atomic<T *> current_;
+    profiled_mutex writer_mutex_{"rcu_publish"}; // serialises writers only, readers never touch it
+    std::vector<std::pair<std::uint64_t, std::unique_ptr<T>>> retired_;
+
+public:
+    explicit rcu_ptr(std::unique_ptr<T> initial)
+        : current_(initial.release()) {}
+
+    ~rcu_ptr()
+    {
+        delete current_.load();
+    }
+
+    // Only valid while the calling thread holds an rcu_domain::read_guard.
+    const T *load() const
+    {
+        return current_.load();
+    }
+
+    void publish(std::unique_ptr<T> next)
+    {
+        std::lock_guard<profiled_mutex> lock(writer_mutex_);
+        std::unique_ptr<T> old(current_.exchange(next.release()));
+        retired_.emplace_back(rcu_domain::instance().advance(), std::move(old));
+        reclaim_locked();
+    }
+
+    // Frees whatever retired objects no reader can still reach. Returns the
+    // number still pending so callers can schedule another attempt.
+    std::size_t reclaim()
+    {
+        std::lock_guard<profiled_mutex> lock(writer_mutex_);
+        return reclaim_locked();
+    }
+
+private:
+    std::size_t reclaim_locked()
+    {
+        auto &domain = rcu_domain::instance();
+        auto it = retired_.begin();
+        while (it != retired_.end())
+        {
+            if (domain.quiescent(it->first))
+                it = retired_.erase(it);
+            else
+                ++it;
+        }
+        return retired_.size();
+    }
+};
+
+// ---------------------------
+// METRICS
+// ---------------------------
+// Process-wide counters and gauges rendered in the Prometheus text format by
+// the `metrics` handler. Series are created once (usually into a static
+// reference) and then updated with plain atomic operations. Each family's
+// text is laid out once, so a scrape only formats the numbers.
+enum class metric_type
+{
+    counter,
+    gauge,
+    histogram,
+};
+
+// Fixed buckets over integer observations (nanoseconds for latencies);
+// observe() is two relaxed atomic adds.
+class metric_histogram
+{
+    std::vector<std::int64_t> bounds_;
+    std::unique_ptr<std::atomic<std::int64_t>[]> buckets_; // last one is +Inf
+    std::atomic<std::int64_t> sum_{0};
+
+public:
+    explicit metric_histogram(std::vector<std::int64_t> bounds)
+        : bounds_(std::move(bounds)), buckets_(new std::atomic<std::int64_t>[bounds_.size() + 1]())
+    {
+    }
+
+    void observe(std::int64_t value)
+    {
+        auto i = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+        buckets_[i].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    const std::vector<std::int64_t> &bounds() const
+    {
+        return bounds_;
+    }
+
+    // Bucket i counts observations up to bounds()[i]; the last one the rest.
+    const std::atomic<std::int64_t> &bucket(std::size_t i) const
+    {
+        return buckets_[i];
+    }
+
+    const std::atomic<std::int64_t> &sum() const
+    {
+        return sum_;
+    }
+};
+
+// Request latency buckets in nanoseconds, 50 us to 10 s.
+inline std::vector<std::int64_t> latency_buckets()
+{
+    return {50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 25000000,
+            50000000, 100000000, 250000000, 500000000, 1000000000, 2500000000, 5000000000, 10000000000};
+}
+
+class metrics_registry
+{
+    // A number in a family's text, ending the fixed text at `end`.
+    struct field
+    {
+        enum kind_t
+        {
+            value,  // *source as is
+            scaled, // *source * scale
+            bucket, // *source added to the running histogram count
+            count,  // the running count, which then restarts
+        } kind;
+        const std::atomic<std::int64_t> *source; // null for count
+        std::size_t end;
+    };
+
+    struct entry
+    {
+        std::string labels; // rendered form, e.g. scope="global"
+        std::atomic<std::int64_t> value{0};
+        std::unique_ptr<metric_histogram> histogram; // histogram families only
+    };
+
+    struct family
+    {
+        std::string name;
+        std::string help;
+        metric_type type;
+        double scale; // multiplied in at render time, e.g. 1e-6 for us -> s
+        std::deque<entry> series; // deque: references stay valid on growth
+
+        // The exposition without its numbers, and where each goes; rebuilt
+        // by layout() when a series is added.
+        std::string text;
+        std::vector<field> fields;
+        std::size_t laid_out = 0; // series covered by `text`
+    };
+
+    profiled_mutex mutex_{"metrics_registry"};
+    std::deque<family> families_;
+    std::vector<std::function<void()>> collectors_;
+    std::size_t last_size_ = 0;
+
+public:
+    static metrics_registry &instance()
+    {
+        static metrics_registry registry;
+        return registry;
+    }
+
+    std::atomic<std::int64_t> &counter(const std::string &name, const std::string &help,
+                                       const std::string &labels = "", double scale = 1)
+    {
+        return get(name, help, metric_type::counter, labels, scale);
+    }
+
+    std::atomic<std::int64_t> &gauge(const std::string &name, const std::string &help,
+                                     const std::string &labels = "", double scale = 1)
+    {
+        return get(name, help, metric_type::gauge, labels, scale);
+    }
+
+    // `bounds` and observations share a unit that `scale` converts to the
+    // exported one, e.g. nanoseconds with 1e-9 for seconds.
+    metric_histogram &histogram(const std::string &name, const std::string &help, const std::string &labels,
+                                std::vector<std::int64_t> bounds, double scale = 1)
+    {
+        // One lock with the lookup, so render() never lays out a histogram
+        // series before its buckets exist.
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        auto &e = get_entry(name, help, metric_type::histogram, labels, scale);
+        if (!e.histogram)
+            e.histogram = std::make_unique<metric_histogram>(std::move(bounds));
+        return *e.histogram;
+    }
+
+    // Runs before every render, for gauges that are cheaper to compute on
+    // scrape than to keep current.
+    void on_collect(std::function<void()> fn)
+    {
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        collectors_.push_back(std::move(fn));
+    }
+
+    std::string render()
+    {
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        for (auto &fn : collectors_)
+            fn();
+
+        std::string out;
+        out.reserve(last_size_ + last_size_ / 8);
+        for (auto &f : families_)
+        {
+            if (f.laid_out != f.series.size())
+                layout(f);
+            std::size_t from = 0;
+            std::int64_t cumulative = 0;
+            for (auto &field : f.fields)
+            {
+                out.append(f.text, from, field.end - from);
+                from = field.end;
+                auto v = field.source ? field.source->load(std::memory_order_relaxed) : 0;
+                switch (field.kind)
+                {
+                case field::value:
+                    append_number(out, v);
+                    break;
+                case field::scaled:
+                    append_number(out, v * f.scale);
+                    break;
+                case field::bucket:
+                    cumulative += v;
+                    append_number(out, cumulative);
+                    break;
+                case field::count:
+                    append_number(out, cumulative);
+                    cumulative = 0;
+                    break;
+                }
+            }
+            out.append(f.text, from, std::string::npos);
+        }
+        last_size_ = out.size();
+        return out;
+    }
+
+private:
+    static void append_number(std::string &out, std::int64_t v)
+    {
+        char buf[24];
+        out.append(buf, std::to_chars(buf, buf + sizeof buf, v).ptr);
+    }
+
+    static void append_number(std::string &out, double v)
+    {
+        char buf[32];
+        out.append(buf, std::to_chars(buf, buf + sizeof buf, v).ptr);
+    }
+
+    static void layout(family &f)
+    {
+        f.text = "# HELP " + f.name + " " + f.help + "\n# TYPE " + f.name + " " +
+                 (f.type == metric_type::counter ? "counter" : f.type == metric_type::gauge ? "gauge"
+                                                                                            : "histogram") +
+                 "\n";
+        f.fields.clear();
+        auto number = [&f](field::kind_t kind, const std::atomic<std::int64_t> *source)
+        {
+            f.fields.push_back({kind, source, f.text.size()});
+            f.text += "\n";
+        };
+        for (auto &s : f.series)
+        {
+            if (!s.histogram)
+            {
+                f.text += s.labels.empty() ? f.name + " " : f.name + "{" + s.labels + "} ";
+                number(f.scale == 1 ? field::value : field::scaled, &s.value);
+                continue;
+            }
+            auto &h = *s.histogram;
+            auto prefix = s.labels.empty() ? std::string("{") : "{" + s.labels + ",";
+            for (std::size_t i = 0; i <= h.bounds().size(); i++)
+            {
+                std::ostringstream le; // stream formatting, as series identity depends on it
+                if (i < h.bounds().size())
+                    le << h.bounds()[i] * f.scale;
+                else
+                    le << "+Inf";
+                f.text += f.name + "_bucket" + prefix + "le=\"" + le.str() + "\"} ";
+                number(field::bucket, &h.bucket(i));
+            }
+            auto suffix = s.labels.empty() ? std::string() : "{" + s.labels + "}";
+            f.text += f.name + "_sum" + suffix + " ";
+            number(field::scaled, &h.sum());
+            f.text += f.name + "_count" + suffix + " ";
+            number(field::count, nullptr);
+        }
+        f.laid_out = f.series.size();
+    }
+
+    std::atomic<std::int64_t> &get(const std::string &name, const std::string &help, metric_type type,
+                                   const std::string &labels, double scale)
+    {
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        return get_entry(name, help, type, labels, scale).value;
+    }
+
+    // Caller holds mutex_.
+    entry &get_entry(const std::string &name, const std::string &help, metric_type type,
+                     const std::string &labels, double scale)
+    {
+        family *f = nullptr;
+        for (auto &existing : families_)
+            if (existing.name == name)
+                f = &existing;
+        if (!f)
+        {
+            families_.emplace_back();
+            f = &families_.back();
+            f->name = name;
+            f->help = help;
+            f->type = type;
+            f->scale = scale;
+        }
+        for (auto &s : f->series)
+            if (s.labels == labels)
+                return s;
+        f->series.emplace_back();
+        f->series.back().labels = labels;
+        return f->series.back();
+    }
+};
+
+// ---------------------------
+// MEMORY ACCOUNTING
+// ---------------------------
+// Bytes held for connections (read buffers, parsed requests, responses
+// waiting to be written) are charged here. Near the limit the registered
+// reclaimers (caches) are asked to give memory back; over it sessions stop
+// reading new requests and dispatch sheds non-critical work.
+class memory_budget
+{
+    std::atomic<std::int64_t> limit_{0}; // 0 = unlimited
+    std::atomic<std::int64_t> &used_;
+    std::atomic<bool> reclaiming_{false};
+    profiled_mutex reclaim_mutex_{"memory_reclaim"};
+    std::vector<std::function<std::size_t(std::size_t)>> reclaimers_;
+
+    memory_budget()
+        : used_(metrics_registry::instance().gauge("memory_used_bytes",
+                                                   "Bytes charged to the memory budget.", "scope=\"global\""))
+    {
+        auto &metrics = metrics_registry::instance();
+        auto &limit = metrics.gauge("memory_budget_bytes", "Configured memory budget, 0 = unlimited.",
+                                    "scope=\"global\"");
+        metrics.on_collect([this, &limit]
+                           { limit = limit_.load(); });
+    }
+
+public:
+    static memory_budget &global()
+    {
+        static memory_budget budget;
+        return budget;
+    }
+
+    void set_limit(std::int64_t bytes)
+    {
+        limit_ = bytes;
+    }
+
+    void charge(std::int64_t delta)
+    {
+        auto used = used_.fetch_add(delta, std::memory_order_relaxed) + delta;
+        auto limit = limit_.load(std::memory_order_relaxed);
+        if (delta > 0 && limit && used > limit - limit / 8)
+            reclaim(static_cast<std::size_t>(used - (limit - limit / 4)));
+    }
+
+    bool exhausted() const
+    {
+        auto limit = limit_.load(std::memory_order_relaxed);
+        return limit && used_.load(std::memory_order_relaxed) > limit;
+    }
+
+    // A reclaimer frees up to the requested number of bytes and returns how
+    // many it released.
+    void add_reclaimer(std::function<std::size_t(std::size_t)> fn)
+    {
+        std::lock_guard<profiled_mutex> lock(reclaim_mutex_);
+        reclaimers_.push_back(std::move(fn));
+    }
+
+private:
+    // One thread reclaims at a time; the others carry on rather than queue up
+    // behind it.
+    void reclaim(std::size_t want)
+    {
+        if (reclaiming_.exchange(true))
+            return;
+        {
+            std::lock_guard<profiled_mutex> lock(reclaim_mutex_);
+            for (auto &fn : reclaimers_)
+            {
+                auto freed = fn(want);
+                if (freed >= want)
+                    break;
+                want -= freed;
+            }
+        }
+        reclaiming_ = false;
+    }
+};
+
+// ---------------------------
+// EXECUTION POOLS AND BULKHEADS
+// ---------------------------
+// Lower value = served first and shed last.
+enum class priority_class : int
+{
+    critical,
+    high,
+    normal,
+    low,
+};
+constexpr std::size_t priority_classes = 4;
+
+const char *priority_name(priority_class p)
+{
+    static const char *names[priority_classes] = {"critical", "high", "normal", "low"};
+    return names[static_cast<int>(p)];
+}
+
+bool parse_priority(boost::beast::string_view text, priority_class &out)
+{
+    for (std::size_t i = 0; i < priority_classes; i++)
+    {
+        if (boost::beast::iequals(text, priority_name(static_cast<priority_class>(i))))
+        {
+            out = static_cast<priority_class>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+using deadline_clock = std::chrono::steady_clock;
+
+// Cancellation slot shared by a request's handler and whatever it starts on
+// the request's behalf. The asio in Boost 1.74 predates per-operation
+// cancellation slots, so this is the minimal equivalent: a flag handlers can
+// poll plus callbacks (e.g. closing an upstream socket) run once on emit.
+class cancellation
+{
+    static lock_site &site()
+    {
+        static lock_site &s = lock_registry::instance().site("cancellation");
+        return s;
+    }
+
+    profiled_mutex mutex_{site()};
+    std::atomic<bool> cancelled_{false};
+    std::vector<std::function<void()>> handlers_;
+
+public:
+    bool cancelled() const
+    {
+        return cancelled_.load(std::memory_order_acquire);
+    }
+
+    // Runs `fn` on emit, or right away if that already happened.
+    void on_cancel(std::function<void()> fn)
+    {
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            if (!cancelled_.load(std::memory_order_relaxed))
+            {
+                handlers_.push_back(std::move(fn));
+                return;
+            }
+        }
+        fn();
+    }
+
+    void emit()
+    {
+        std::vector<std::function<void()>> handlers;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            if (cancelled_.exchange(true))
+                return;
+            handlers.swap(handlers_);
+        }
+        for (auto &fn : handlers)
+            fn();
+    }
+};
+
+// Work handed off the I/O threads. `reject` runs instead of `run` when the job
+// is shed (503) or its deadline passes while it waits in a queue (504), so the
+// session can still answer. A job whose client went away is dropped the same
+// way; the session then skips the write.
+struct pool_job
+{
+    std::function<void()> run;
+    std::function<void(http::status)> reject;
+    priority_class priority = priority_class::normal;
+    deadline_clock::time_point deadline = deadline_clock::time_point::max();
+    std::shared_ptr<cancellation> cancel;
+
+    bool abandoned(deadline_clock::time_point now) const
+    {
+        return deadline <= now || (cancel && cancel->cancelled());
+    }
+};
+
+// Bounded FIFO per priority class. Pops take the highest class first; a push
+// into a full queue evicts the newest job of the lowest class below the
+// incoming one, so lower classes are always the first to be shed.
+class job_queue
+{
+    std::array<std::deque<pool_job>, priority_classes> by_class_;
+    std::size_t size_ = 0;
+
+public:
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    // Returns false if nothing had to go. Otherwise `shed` holds the job that
+    // lost its place, which is `job` itself when nothing lower was queued.
+    bool push(pool_job job, std::size_t capacity, pool_job &shed)
+    {
+        if (size_ >= capacity)
+        {
+            auto incoming = static_cast<std::size_t>(job.priority);
+            for (auto c = priority_classes; c-- > incoming + 1;)
+            {
+                if (!by_class_[c].empty())
+                {
+                    shed = std::move(by_class_[c].back());
+                    by_class_[c].pop_back();
+                    by_class_[incoming].push_back(std::move(job));
+                    return true;
+                }
+            }
+            shed = std::move(job);
+            return true;
+        }
+        by_class_[static_cast<std::size_t>(job.priority)].push_back(std::move(job));
+        size_++;
+        return false;
+    }
+
+    // Abandoned jobs met on the way are moved to `dropped` for the caller to
+    // reject outside its lock; returns an empty job if nothing live is left.
+    pool_job pop(std::vector<pool_job> &dropped)
+    {
+        auto now = deadline_clock::now();
+        for (auto &q : by_class_)
+        {
+            while (!q.empty())
+            {
+                pool_job job = std::move(q.front());
+                q.pop_front();
+                size_--;
+                if (!job.abandoned(now))
+                    return job;
+                dropped.push_back(std::move(job));
+            }
+        }
+        return {};
+    }
+};
+
+// True on exec_pool workers, the only threads where a handler may block.
+thread_local bool on_pool_thread = false;
+
+// A named set of worker threads with one bounded queue. Routes assigned to a
+// pool run there, so a slow handler ties up its pool and not the I/O threads.
+class exec_pool
+{
+    // Shared with the workers: the last route referencing a pool may drop it
+    // from inside one of its own jobs, so workers are detached and outlive
+    // the exec_pool object until they have drained the queue.
+    struct state
+    {
+        profiled_mutex mutex{"exec_pool"};
+        std::condition_variable_any ready;
+        job_queue queue;
+        std::size_t max_queue;
+        bool stopping = false;
+    };
+    std::shared_ptr<state> state_;
+
+public:
+    const std::string name;
+    const int threads;
+
+    exec_pool(std::string name, int threads, std::size_t max_queue)
+        : state_(std::make_shared<state>()), name(std::move(name)), threads(threads)
+    {
+        state_->max_queue = max_queue;
+        for (int i = 0; i < threads; i++)
+            std::thread([s = state_]
+                        { work(*s); })
+                .detach();
+    }
+
+    ~exec_pool()
+    {
+        {
+            std::lock_guard<profiled_mutex> lock(state_->mutex);
+            state_->stopping = true;
+        }
+        state_->ready.notify_all();
+    }
+
+    std::size_t max_queue() const
+    {
+        return state_->max_queue;
+    }
+
+    std::size_t queued() const
+    {
+        std::lock_guard<profiled_mutex> lock(state_->mutex);
+        return state_->queue.size();
+    }
+
+    void submit(pool_job job)
+    {
+        pool_job shed;
+        bool full;
+        {
+            std::lock_guard<profiled_mutex> lock(state_->mutex);
+            full = state_->queue.push(std::move(job), state_->max_queue, shed);
+        }
+        if (full)
+            shed.reject(http::status::service_unavailable);
+        else
+            state_->ready.notify_one();
+    }
+
+private:
+    static void work(state &s)
+    {
+        on_pool_thread = true;
+        std::vector<pool_job> dropped;
+        for (;;)
+        {
+            pool_job job;
+            {
+                std::unique_lock<profiled_mutex> lock(s.mutex);
+                s.ready.wait(lock, [&s]
+                             { return s.stopping || !s.queue.empty(); });
+                if (s.queue.empty())
+                    return;
+                job = s.queue.pop(dropped);
+            }
+            for (auto &d : dropped)
+                d.reject(http::status::gateway_timeout);
+            dropped.clear();
+            if (job.run)
+                job.run();
+        }
+    }
+};
+
+// Per-route isolation: at most `limit` requests of the route run at once and
+// at most `max_waiting` more wait in the route's own queue; anything beyond
+// that is rejected immediately instead of piling up behind a slow handler.
+class bulkhead : public std::enable_shared_from_this<bulkhead>
+{
+    profiled_mutex mutex_{"bulkhead"};
+    std::size_t running_ = 0;
+    job_queue waiting_;
+
+public:
+    const std::size_t limit; // 0 = unlimited
+    const std::size_t max_waiting;
+    const std::shared_ptr<exec_pool> pool; // null = run on the I/O thread
+
+    bulkhead(std::size_t limit, std::size_t max_waiting, std::shared_ptr<exec_pool> pool)
+        : limit(limit), max_waiting(max_waiting), pool(std::move(pool)) {}
+
+    std::size_t waiting()
+    {
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        return waiting_.size();
+    }
+
+    void submit(pool_job job)
+    {
+        pool_job shed;
+        bool full;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            if (!limit || running_ < limit)
+            {
+                running_++;
+                full = false;
+            }
+            else if (!(full = waiting_.push(std::move(job), max_waiting, shed)))
+                return;
+        }
+        if (full)
+            shed.reject(http::status::service_unavailable);
+        else
+            start(std::move(job));
+    }
+
+private:
+    void start(pool_job job)
+    {
+        auto self = shared_from_this();
+        pool_job tracked{
+            [self, run = std::move(job.run)]
+            {
+                run();
+                self->finish();
+            },
+            [self, reject = std::move(job.reject)](http::status status)
+            {
+                reject(status);
+                self->finish();
+            },
+            job.priority,
+            job.deadline,
+            job.cancel};
+
+        if (pool)
+            pool->submit(std::move(tracked));
+        else
+            tracked.run();
+    }
+
+    // Hands the finished job's slot straight to the highest waiting job that
+    // is still wanted.
+    void finish()
+    {
+        pool_job next;
+        std::vector<pool_job> dropped;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            next = waiting_.pop(dropped);
+            if (!next.run)
+                running_--;
+        }
+        for (auto &d : dropped)
+            d.reject(http::status::gateway_timeout);
+        if (next.run)
+            start(std::move(next));
+    }
+};
+
+// ---------------------------
+// CONFIGURATION
+// ---------------------------
+// An open file sent as a response body with sendfile(); closed when the last
+// reply referencing it (including a cached one) goes away.
+struct file_source
+{
+    int fd;
+    std::uint64_t size;
+
+    file_source(int fd, std::uint64_t size)
+        : fd(fd), size(size) {}
+
+    ~file_source()
+    {
+        ::close(fd);
+    }
+
+    file_source(const file_source &) = delete;
+    file_source &operator=(const file_source &) = delete;
+};
+
+struct reply
+{
+    http::status status = http::status::ok;
+    std::string content_type; // omitted from the response when empty
+    std::string body;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::shared_ptr<const file_source> file; // when set, the body comes from here
+};
+
+// What a handler sees of a request. Handlers that call other services should
+// pass `remaining()` on as the upstream timeout and hook `cancel` to abort the
+// call if the client disconnects; long running handlers should poll
+// `cancelled()`.
+struct request_context
+{
+    const http::request<http::string_body> &req;
+    deadline_clock::time_point deadline = deadline_clock::time_point::max();
+    std::shared_ptr<cancellation> cancel; // null for inline handlers
+
+    bool cancelled() const
+    {
+        return cancel && cancel->cancelled();
+    }
+
+    bool expired() const
+    {
+        return deadline_clock::now() >= deadline;
+    }
+
+    // Time left before the deadline; max() when the request has none.
+    std::chrono::milliseconds remaining() const
+    {
+        if (deadline == deadline_clock::time_point::max())
+            return std::chrono::milliseconds::max();
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - deadline_clock::now());
+        return std::max(left, std::chrono::milliseconds(0));
+    }
+};
+
+using handler_fn = std::function<reply(const request_context &)>;
+
+struct route
+{
+    std::string path;
+    std::string handler_name;
+    handler_fn handler;
+    std::shared_ptr<bulkhead> isolation; // null = run inline, no limits
+    priority_class priority = priority_class::normal;
+    std::chrono::milliseconds budget{0}; // 0 = settings.default_budget
+    std::chrono::milliseconds cache_ttl{0}; // 0 = replies are not cached
+    metric_histogram *latency = nullptr;    // http_request_duration_seconds{route=path}
+    std::atomic<std::int64_t> *cpu = nullptr;   // http_handler_cpu_seconds_total{route=path}, ns
+    std::atomic<std::int64_t> *calls = nullptr; // http_handler_calls_total{route=path}
+};
+
+enum class body_kind
+{
+    memory,   // body held in the reply
+    zerocopy, // body held in the reply, sent with MSG_ZEROCOPY
+    file,     // body sent from a file with sendfile()
+};
+constexpr std::size_t body_kinds = 3;
+
+enum class coalesce_mode
+{
+    none,   // header and body as separate sends
+    writev, // one gather write (in-memory bodies only)
+    more,   // header sent with MSG_MORE so it waits for the body
+    cork,   // TCP_CORK held across header and body
+};
+
+enum class io_backend
+{
+    asio,  // io_context, sessions and completion handlers
+    epoll, // per-thread edge-triggered reactor, run to completion
+    uring, // epoll reactor sending cache hits through io_uring
+};
+
+struct server_settings
+{
+    // Read once at startup; a reload that changes them only logs a warning.
+    unsigned short port = 8090;
+    int threads = 0; // 0 = std::thread::hardware_concurrency()
+    io_backend backend = io_backend::asio;
+
+    std::string server_name = "Boost.Beast Server";
+
+    // Lets a trusted front end raise or lower a request's class. Off (empty)
+    // unless configured, as any client could otherwise claim critical.
+    std::string priority_header;
+
+    // Under overload a class is shed once this many requests are in flight
+    // across the server; 0 = never. Critical requests are never shed.
+    std::array<std::size_t, priority_classes> shed_inflight = {};
+
+    // A request's deadline is the tighter of its route budget (or this
+    // default) and the timeout the client sends in timeout_header. 0 / empty
+    // disables either source.
+    std::chrono::milliseconds default_budget{0};
+    std::string timeout_header = "X-Request-Timeout";
+
+    // Memory charged for all connections together (0 = unlimited) and for
+    // any one of them; a request bigger than the latter is refused with 413.
+    std::int64_t memory_limit = 0;
+    std::size_t connection_memory = 1024 * 1024;
+
+    std::size_t cache_capacity = 64 * 1024 * 1024;
+
+    // Bodies at least this large are sent with MSG_ZEROCOPY; 0 = never.
+    std::size_t zerocopy_threshold = 0;
+
+    // How the header and body of each kind of response are put on the wire.
+    std::array<coalesce_mode, body_kinds> coalesce = {coalesce_mode::writev, coalesce_mode::more,
+                                                      coalesce_mode::cork};
+
+    // The pressure monitor maps PSI "some avg10" (percent) and cgroup usage
+    // (fraction of memory.max) between these marks onto cache shrinking.
+    double pressure_psi_low = 10, pressure_psi_high = 60;
+    double pressure_usage_low = 0.80, pressure_usage_high = 0.95;
+    std::chrono::milliseconds pressure_interval{1000};
+
+    // Busy polling for dedicated cores: I/O threads spin this long without
+    // work before sleeping (0 = sleep at once; read at startup), and accepted
+    // sockets get SO_BUSY_POLL with this many microseconds (0 = off).
+    std::chrono::microseconds busy_poll{0};
+    int busy_poll_socket = 0;
+
+    // How long a kept-alive connection may sit idle before the next request;
+    // 0 = close every connection after one response.
+    std::chrono::milliseconds keepalive_timeout{5000};
+
+    // Slow client defenses, 0 = off. A request header must be complete
+    // within header_timeout of the connection being ready for it; request
+    // bodies and responses must average min_data_rate bytes/s over every
+    // min_rate_window; send_queue caps the unsent response bytes a socket
+    // buffers (TCP_NOTSENT_LOWAT, applied on accept).
+    std::chrono::milliseconds header_timeout{10000};
+    std::uint64_t min_data_rate = 240;
+    std::chrono::milliseconds min_rate_window{5000};
+    int send_queue = 0;
+
+    // Load reports: the score is recomputed every load_interval and smoothed
+    // with load_half_life; this many requests in flight, this much event loop
+    // lag or this many queued jobs each count as fully loaded. load_header
+    // names the response header that carries the report; empty = off.
+    std::chrono::milliseconds load_interval{250};
+    std::chrono::milliseconds load_half_life{2000};
+    std::size_t load_in_flight = 256;
+    std::chrono::milliseconds load_lag{50};
+    std::size_t load_queue = 256;
+    std::string load_header;
+
+    // Peer cache fill: the group (host:port of every instance, this one
+    // included as peer_self; empty = off), how long a fill may take before
+    // the handler runs locally, how long a filled reply is kept here, and
+    // the idle connections kept per peer.
+    std::vector<std::string> peers;
+    std::string peer_self;
+    std::chrono::milliseconds peer_timeout{250};
+    std::chrono::milliseconds peer_local{1000};
+    std::size_t peer_connections = 8;
+
+    // Shared-memory metrics segment for metricsctl; empty name = off.
+    std::string metrics_shm;
+    std::size_t metrics_shm_size = 1024 * 1024;
+    std::chrono::milliseconds metrics_shm_interval{1000};
+
+    // Per-site lock wait and hold times for the `locks` handler.
+    bool lock_profiling = false;
+
+    // Traffic capture for loadgen replay; empty path = off.
+    std::string capture_path;
+    std::uint64_t capture_sample = 1;
+    std::uint64_t capture_max = 64 * 1024 * 1024;
+};
+
+struct loaded_module;
+
+// Immutable once published. Sessions read it under an rcu read_guard and copy
+// out the shared_ptr of the route they need before leaving the guard.
+struct config_snapshot
+{
+    server_settings settings;
+    std::unordered_map<std::string, std::shared_ptr<const route>> routes;
+    std::unordered_map<std::string, std::shared_ptr<loaded_module>> modules;
+    std::unordered_map<std::string, std::shared_ptr<exec_pool>> pools;
+};
+
+// Pool that reads cold static files into the page cache so the I/O threads
+// never block on the disk; sized with `pool file_io threads=N` like any other.
+const char *const file_io_pool = "file_io";
+
+rcu_ptr<config_snapshot> &active_config();
+
+// Splits a config line into whitespace separated words; double quotes group
+// words and support \n, \" and \\ escapes.
+std::vector<std::string> tokenize(const std::string &line)
+{
+    std::vector<std::string> words;
+    std::string word;
+    bool quoted = false, have_word = false;
+
+    for (std::size_t i = 0; i < line.size(); i++)
+    {
+        char c = line[i];
+        if (quoted)
+        {
+            if (c == '"')
+                quoted = false;
+            else if (c == '\\' && i + 1 < line.size())
+            {
+                char e = line[++i];
+                word += e == 'n' ? '\n' : e;
+            }
+            else
+                word += c;
+        }
+        else if (c == '#')
+            break;
+        else if (c == '"')
+            quoted = have_word = true;
+        else if (c == ' ' || c == '\t' || c == '\r')
+        {
+            if (have_word)
+                words.push_back(std::move(word));
+            word.clear();
+            have_word = false;
+        }
+        else
+        {
+            word += c;
+            have_word = true;
+        }
+    }
+    if (quoted)
+        throw std::runtime_error("unterminated quote");
+    if (have_word)
+        words.push_back(std::move(word));
+    return words;
+}
+
+// ---------------------------
+// RESPONSE CACHE
+// ---------------------------
+// LRU cache of successful GET replies for routes with `cache_ms=N`. Entries
+// are charged to the memory budget, which can ask for bytes back, and the
+// pressure monitor lowers the effective capacity as the cgroup fills up.
+class response_cache
+{
+    struct entry
+    {
+        std::string key;
+        std::shared_ptr<const reply> value;
+        deadline_clock::time_point expires;
+        std::size_t bytes;
+    };
+
+    profiled_mutex mutex_{"response_cache"};
+    std::list<entry> lru_; // most recently used first
+    std::unordered_map<std::string, std::list<entry>::iterator> index_;
+    std::size_t bytes_ = 0;
+    std::size_t capacity_ = 0;
+    double pressure_ = 0; // 0 = full capacity, 1 = cache disabled
+
+    std::atomic<std::int64_t> &hits_;
+    std::atomic<std::int64_t> &misses_;
+    std::atomic<std::int64_t> &bytes_gauge_;
+    std::atomic<std::int64_t> &capacity_gauge_;
+
+    response_cache()
+        : hits_(metrics_registry::instance().counter("cache_hits_total", "Response cache hits.")),
+          misses_(metrics_registry::instance().counter("cache_misses_total", "Response cache misses.")),
+          bytes_gauge_(metrics_registry::instance().gauge("cache_bytes", "Bytes held by the response cache.")),
+          capacity_gauge_(metrics_registry::instance().gauge(
+              "cache_capacity_bytes", "Response cache capacity after memory pressure adjustment."))
+    {
+        memory_budget::global().add_reclaimer([this](std::size_t want)
+                                              { return evict(want, "budget"); });
+    }
+
+    static std::size_t size_of(const std::string &key, const reply &r)
+    {
+        std::size_t bytes = sizeof(entry) + key.size() + r.body.size() + r.content_type.size();
+        for (auto &h : r.headers)
+            bytes += h.first.size() + h.second.size();
+        return bytes;
+    }
+
+    std::size_t effective_capacity() const
+    {
+        return static_cast<std::size_t>(capacity_ * (1 - pressure_));
+    }
+
+    // Drops least recently used entries until at most `target` bytes remain.
+    // Returns the bytes freed; the caller uncharges them outside the lock.
+    std::size_t trim_locked(std::size_t target, const char *reason)
+    {
+        std::size_t freed = 0;
+        while (bytes_ > target && !lru_.empty())
+        {
+            auto &victim = lru_.back();
+            freed += victim.bytes;
+            bytes_ -= victim.bytes;
+            index_.erase(victim.key);
+            lru_.pop_back();
+        }
+        if (freed)
+            count_eviction(reason, freed);
+        bytes_gauge_ = static_cast<std::int64_t>(bytes_);
+        return freed;
+    }
+
+    static void count_eviction(const char *reason, std::size_t bytes)
+    {
+        auto &metrics = metrics_registry::instance();
+        metrics.counter("cache_evicted_bytes_total", "Bytes evicted from the response cache.",
+                        std::string("reason=\"") + reason + "\"") += static_cast<std::int64_t>(bytes);
+    }
+
+public:
+    static response_cache &instance()
+    {
+        static response_cache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const reply> find(const std::string &key)
+    {
+        std::size_t freed = 0;
+        std::shared_ptr<const reply> found;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            auto it = index_.find(key);
+            if (it != index_.end())
+            {
+                if (it->second->expires > deadline_clock::now())
+                {
+                    lru_.splice(lru_.begin(), lru_, it->second);
+                    found = it->second->value;
+                }
+                else
+                {
+                    freed = it->second->bytes;
+                    bytes_ -= freed;
+                    lru_.erase(it->second);
+                    index_.erase(it);
+                    bytes_gauge_ = static_cast<std::int64_t>(bytes_);
+                }
+            }
+        }
+        memory_budget::global().charge(-static_cast<std::int64_t>(freed));
+        (found ? hits_ : misses_)++;
+        return found;
+    }
+
+    void insert(const std::string &key, std::shared_ptr<const reply> value, std::chrono::milliseconds ttl)
+    {
+        auto bytes = size_of(key, *value);
+        std::size_t freed = 0;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            if (bytes > effective_capacity())
+                return;
+            auto it = index_.find(key);
+            if (it != index_.end())
+            {
+                freed += it->second->bytes;
+                bytes_ -= it->second->bytes;
+                lru_.erase(it->second);
+                index_.erase(it);
+            }
+            freed += trim_locked(effective_capacity() - bytes, "capacity");
+            lru_.push_front(entry{key, std::move(value), deadline_clock::now() + ttl, bytes});
+            index_[key] = lru_.begin();
+            bytes_ += bytes;
+            bytes_gauge_ = static_cast<std::int64_t>(bytes_);
+        }
+        memory_budget::global().charge(static_cast<std::int64_t>(bytes) - static_cast<std::int64_t>(freed));
+    }
+
+    void set_capacity(std::size_t bytes)
+    {
+        std::size_t freed;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            capacity_ = bytes;
+            capacity_gauge_ = static_cast<std::int64_t>(effective_capacity());
+            freed = trim_locked(effective_capacity(), "capacity");
+        }
+        memory_budget::global().charge(-static_cast<std::int64_t>(freed));
+    }
+
+    // 0 keeps the configured capacity, 1 empties the cache; values in between
+    // shrink it proportionally.
+    void set_pressure(double pressure)
+    {
+        std::size_t freed;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            pressure_ = std::min(std::max(pressure, 0.0), 1.0);
+            capacity_gauge_ = static_cast<std::int64_t>(effective_capacity());
+            freed = trim_locked(effective_capacity(), "pressure");
+        }
+        memory_budget::global().charge(-static_cast<std::int64_t>(freed));
+    }
+
+    std::size_t evict(std::size_t want, const char *reason)
+    {
+        std::size_t freed;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            freed = trim_locked(bytes_ > want ? bytes_ - want : 0, reason);
+        }
+        memory_budget::global().charge(-static_cast<std::int64_t>(freed));
+        return freed;
+    }
+};
+
+// ---------------------------
+// PEER CACHE FILL
+// ---------------------------
+// With `peers`, instances share the work of cacheable routes. Each cache key
+// (the request target) is owned by one peer on a consistent hash ring. A local
+// miss on a key owned elsewhere asks the owner over a kept-alive connection
+// before running the handler, so the owner computes and stores each object
+// once for the group. Requests between peers carry X-Peer-Fill and are never
+// forwarded again. A failure or a non-200 answer falls back to the local
+// handler. Fills block for up to peers timeout_ms, so they only happen on
+// pool threads: routes without pool= (and the reactor backends, which run
+// handlers inline) compute their misses locally.
+class peer_cache
+{
+    static constexpr int ring_points = 100; // per peer
+    static constexpr std::size_t max_body = 64 * 1024 * 1024;
+
+    struct peer
+    {
+        std::string name; // host:port as configured
+        sockaddr_storage addr = {};
+        socklen_t addr_len = 0; // 0 = did not resolve
+        profiled_mutex mutex{"peer_connections"};
+        std::vector<int> idle; // kept-alive connections, newest last
+
+        std::atomic<std::int64_t> *ok;
+        std::atomic<std::int64_t> *failed;
+        std::atomic<std::int64_t> *refused; // the owner answered, but not 200
+        metric_histogram *latency;
+
+        ~peer()
+        {
+            for (int fd : idle)
+                ::close(fd);
+        }
+    };
+
+    // Immutable once published; peers live on in groups that keep them.
+    struct group
+    {
+        std::vector<std::shared_ptr<peer>> peers;
+        std::vector<std::pair<std::uint64_t, std::size_t>> ring; // point, peer
+        std::size_t self = 0;
+        std::chrono::milliseconds timeout{0};
+        std::chrono::milliseconds local{0};
+        std::size_t connections = 0;
+    };
+
+    rcu_ptr<group> group_{std::make_unique<group>()};
+    std::vector<std::string> names_; // what group_ was built from
+    std::string self_;
+
+    peer_cache() = default;
+
+public:
+    static peer_cache &instance()
+    {
+        static peer_cache cache;
+        return cache;
+    }
+
+    // FNV-1a with a murmur finaliser: stable across builds and processes,
+    // which std::hash is not required to be.
+    static std::uint64_t hash(const std::string &s)
+    {
+        std::uint64_t h = 14695981039346656037ULL;
+        for (unsigned char c : s)
+            h = (h ^ c) * 1099511628211ULL;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 33);
+    }
+
+    // Called from apply_settings; connections to peers that stay in the
+    // group are kept.
+    void configure(const server_settings &s)
+    {
+        auto next = std::make_unique<group>();
+        next->timeout = s.peer_timeout;
+        next->local = s.peer_local;
+        next->connections = s.peer_connections;
+        if (s.peers == names_ && s.peer_self == self_)
+        {
+            rcu_domain::read_guard guard;
+            next->peers = group_.load()->peers;
+            next->ring = group_.load()->ring;
+            next->self = group_.load()->self;
+            group_.publish(std::move(next));
+            return;
+        }
+
+        std::unordered_map<std::string, std::shared_ptr<peer>> kept;
+        {
+            rcu_domain::read_guard guard;
+            for (auto &p : group_.load()->peers)
+                kept[p->name] = p;
+        }
+        for (std::size_t i = 0; i < s.peers.size(); i++)
+        {
+            auto &name = s.peers[i];
+            if (name == s.peer_self)
+                next->self = i;
+            auto it = kept.find(name);
+            next->peers.push_back(it != kept.end() ? it->second : make_peer(name));
+            for (int v = 0; v < ring_points; v++)
+                next->ring.emplace_back(hash(name + "#" + std::to_string(v)), i);
+        }
+        std::sort(next->ring.begin(), next->ring.end());
+        group_.publish(std::move(next));
+        names_ = s.peers;
+        self_ = s.peer_self;
+    }
+
+    // The owner's reply for a cacheable GET that missed locally, or null to
+    // run the handler here. Stored locally for at most peers local_ms.
+    std::shared_ptr<const reply> fill(const request_context &ctx, std::chrono::milliseconds &keep)
+    {
+        if (!on_pool_thread || ctx.req.count("X-Peer-Fill"))
+            return nullptr;
+        std::string key(ctx.req.target());
+        std::shared_ptr<peer> owner;
+        auto deadline = deadline_clock::now();
+        std::size_t max_idle;
+        std::string load_header;
+        {
+            rcu_domain::read_guard guard;
+            load_header = active_config().load()->settings.load_header;
+            auto g = group_.load();
+            if (g->ring.empty())
+                return nullptr;
+            auto it = std::upper_bound(g->ring.begin(), g->ring.end(),
+                                       std::make_pair(hash(key), std::numeric_limits<std::size_t>::max()));
+            auto index = (it == g->ring.end() ? g->ring.front() : *it).second;
+            if (index == g->self)
+                return nullptr;
+            owner = g->peers[index];
+            deadline += g->timeout;
+            keep = g->local;
+            max_idle = g->connections;
+        }
+        deadline = std::min(deadline, ctx.deadline);
+
+        auto start = tsc_clock::now();
+        bool refused = false;
+        auto r = fetch(*owner, ctx, key, deadline, max_idle, load_header, refused);
+        if (r)
+        {
+            (*owner->ok)++;
+            owner->latency->observe((tsc_clock::now() - start).count());
+        }
+        else
+            (*(refused ? owner->refused : owner->failed))++;
+        return r;
+    }
+
+private:
+    static std::shared_ptr<peer> make_peer(const std::string &name)
+    {
+        auto p = std::make_shared<peer>();
+        p->name = name;
+        auto colon = name.rfind(':');
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *found = nullptr;
+        if (colon != std::string::npos &&
+            ::getaddrinfo(name.substr(0, colon).c_str(), name.substr(colon + 1).c_str(), &hints, &found) == 0)
+        {
+            std::memcpy(&p->addr, found->ai_addr, found->ai_addrlen);
+            p->addr_len = found->ai_addrlen;
+            ::freeaddrinfo(found);
+        }
+        else
+            std::cerr << "peers: cannot resolve " << name << ", its keys are computed locally\n";
+
+        auto &metrics = metrics_registry::instance();
+        auto label = "peer=\"" + name + "\"";
+        auto result = [&](const char *r)
+        {
+            return &metrics.counter("peer_fills_total", "Cache misses sent to the owning peer, by result.",
+                                    label + ",result=\"" + r + "\"");
+        };
+        p->ok = result("ok");
+        p->failed = result("failed");
+        p->refused = result("refused");
+        p->latency = &metrics.histogram("peer_fill_duration_seconds", "Time to fetch a reply from its owner.",
+                                        label, latency_buckets(), 1e-9);
+        return p;
+    }
+
+    // Waits for `events` on `fd` in short slices so a cancelled request
+    // gives up promptly. False on timeout or cancellation.
+    static bool wait(int fd, short events, deadline_clock::time_point deadline, const request_context &ctx)
+    {
+        for (;;)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - deadline_clock::now());
+            if (left.count() <= 0 || ctx.cancelled())
+                return false;
+            pollfd p = {fd, events, 0};
+            int n = ::poll(&p, 1, static_cast<int>(std::min<std::int64_t>(left.count(), 50)));
+            if (n > 0)
+                return true;
+            if (n < 0 && errno != EINTR)
+                return false;
+        }
+    }
+
+    static int connect_to(const peer &p, deadline_clock::time_point deadline, const request_context &ctx)
+    {
+        if (!p.addr_len)
+            return -1;
+        int fd = ::socket(p.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return -1;
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        int err = 0;
+        socklen_t len = sizeof err;
+        if (::connect(fd, reinterpret_cast<const sockaddr *>(&p.addr), p.addr_len) == 0 ||
+            (errno == EINPROGRESS && wait(fd, POLLOUT, deadline, ctx) &&
+             ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0))
+            return fd;
+        ::close(fd);
+        return -1;
+    }
+
+    // A kept-alive connection the owner has not closed meanwhile, or -1.
+    static int take_idle(peer &p)
+    {
+        std::lock_guard<profiled_mutex> lock(p.mutex);
+        while (!p.idle.empty())
+        {
+            int fd = p.idle.back();
+            p.idle.pop_back();
+            pollfd check = {fd, POLLIN | POLLRDHUP, 0};
+            if (::poll(&check, 1, 0) == 0)
+                return fd;
+            ::close(fd); // closed by the owner (keepalive_timeout_ms) or stray bytes
+        }
+        return -1;
+    }
+
+    static void give_back(peer &p, int fd, std::size_t max_idle)
+    {
+        {
+            std::lock_guard<profiled_mutex> lock(p.mutex);
+            if (p.idle.size() < max_idle)
+            {
+                p.idle.push_back(fd);
+                return;
+            }
+        }
+        ::close(fd);
+    }
+
+    // Whether the owner's header `f` belongs in the filled reply: end-to-end
+    // headers do, as the handler set them. Hop-by-hop headers (including any
+    // the Connection header names), and those this server writes itself, do
+    // not.
+    static bool end_to_end(const http::fields::value_type &f, const http::fields &all, const std::string &load_header)
+    {
+        switch (f.name())
+        {
+        case http::field::connection:
+        case http::field::keep_alive:
+        case http::field::proxy_connection:
+        case http::field::proxy_authenticate:
+        case http::field::proxy_authorization:
+        case http::field::te:
+        case http::field::trailer:
+        case http::field::transfer_encoding:
+        case http::field::upgrade:
+        case http::field::server:
+        case http::field::content_length:
+        case http::field::content_type:
+            return false;
+        default:
+            break;
+        }
+        auto name = f.name_string();
+        if (!load_header.empty() && boost::beast::iequals(name, load_header))
+            return false;
+        for (auto &token : http::token_list(all[http::field::connection]))
+            if (boost::beast::iequals(token, name))
+                return false;
+        return true;
+    }
+
+    static std::shared_ptr<const reply> fetch(peer &p, const request_context &ctx, const std::string &key,
+                                              deadline_clock::time_point deadline, std::size_t max_idle,
+                                              const std::string &load_header, bool &refused)
+    {
+        auto request = "GET " + key + " HTTP/1.1\r\nHost: " + p.name + "\r\nX-Peer-Fill: 1\r\n\r\n";
+        // A reused connection can still die under us; then one fresh try.
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            int fd = attempt == 0 ? take_idle(p) : -1;
+            bool reused = fd >= 0;
+            if (!reused && (fd = connect_to(p, deadline, ctx)) < 0)
+                return nullptr;
+
+            bool sent = true;
+            for (std::size_t off = 0; sent && off < request.size();)
+            {
+                auto n = ::send(fd, request.data() + off, request.size() - off, MSG_NOSIGNAL);
+                if (n > 0)
+                    off += n;
+                else if (n < 0 && errno == EAGAIN)
+                    sent = wait(fd, POLLOUT, deadline, ctx);
+                else if (!(n < 0 && errno == EINTR))
+                    sent = false;
+            }
+
+            http::response_parser<http::string_body> parser;
+            parser.eager(true);
+            parser.body_limit(max_body);
+            bool got_any = false;
+            char buf[16 * 1024];
+            while (sent && !parser.is_done())
+            {
+                auto n = ::recv(fd, buf, sizeof buf, 0);
+                if (n < 0 && errno == EAGAIN)
+                {
+                    if (!wait(fd, POLLIN, deadline, ctx))
+                        break;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                    continue;
+                boost::beast::error_code ec;
+                if (n <= 0)
+                {
+                    if (n == 0)
+                        parser.put_eof(ec); // completes a body delimited by close
+                    break;
+                }
+                got_any = true;
+                for (std::size_t used = 0; used < static_cast<std::size_t>(n) && !ec && !parser.is_done();)
+                {
+                    used += parser.put(boost::asio::buffer(buf + used, n - used), ec);
+                    if (ec == http::error::need_more)
+                        ec = {};
+                }
+                if (ec)
+                    break;
+            }
+
+            if (!parser.is_done())
+            {
+                ::close(fd);
+                // Nothing came back on a reused connection: the owner closed
+                // it just as we wrote. Anything else is not worth a retry.
+                if (reused && !got_any && !ctx.cancelled() && deadline_clock::now() < deadline)
+                    continue;
+                return nullptr;
+            }
+
+            auto &res = parser.get();
+            if (res.keep_alive())
+                give_back(p, fd, max_idle);
+            else
+                ::close(fd);
+            if (res.result() != http::status::ok)
+            {
+                refused = true;
+                return nullptr;
+            }
+            reply r;
+            r.content_type = std::string(res[http::field::content_type]);
+            for (auto &f : res)
+                if (end_to_end(f, res, load_header))
+                    r.headers.emplace_back(std::string(f.name_string()), std::string(f.value()));
+            r.body = std::move(res.body());
+            return std::make_shared<const reply>(std::move(r));
+        }
+        return nullptr;
+    }
+};
+
+// ---------------------------
+// TRAFFIC CAPTURE
+// ---------------------------
+// `capture <file> sample=N max_mb=M` records every Nth request, re-serialised
+// with its original header order and spelling, with its arrival time, for
+// `loadgen replay`. The file is the 8 byte magic "HTTPCAP1" followed by one
+// record per request: u64 nanoseconds since capture started, u32 length, then
+// the request bytes (integers in host byte order). Capturing stops for good once
+// the file would grow past the cap.
+class traffic_capture
+{
+    profiled_mutex mutex_{"traffic_capture"};
+    std::FILE *file_ = nullptr;
+    std::string path_;
+    std::uint64_t max_bytes_ = 0;
+    std::uint64_t written_ = 0;
+    tsc_clock::time_point start_;
+    std::atomic<std::uint64_t> sample_{0}; // 0 = not capturing
+    std::atomic<std::uint64_t> seen_{0};
+
+public:
+    static traffic_capture &instance()
+    {
+        static traffic_capture capture;
+        return capture;
+    }
+
+    // Starts capturing into `path` (truncating it), or stops for an empty
+    // path. Reapplying the current settings keeps the capture running.
+    void configure(const std::string &path, std::uint64_t sample, std::uint64_t max_bytes)
+    {
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        if (path == path_ && max_bytes == max_bytes_)
+        {
+            if (file_)
+                sample_ = sample;
+            return;
+        }
+        stop();
+        path_ = path;
+        max_bytes_ = max_bytes;
+        if (path.empty())
+            return;
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_)
+        {
+            std::cerr << "capture: cannot open " << path << ": " << std::strerror(errno) << "\n";
+            return;
+        }
+        std::fwrite("HTTPCAP1", 1, 8, file_);
+        written_ = 8;
+        start_ = tsc_clock::now();
+        seen_ = 0;
+        sample_ = std::max<std::uint64_t>(sample, 1);
+    }
+
+    void record(const http::request<http::string_body> &req, tsc_clock::time_point arrived)
+    {
+        auto sample = sample_.load(std::memory_order_relaxed);
+        if (!sample || seen_.fetch_add(1, std::memory_order_relaxed) % sample)
+            return;
+
+        std::ostringstream out;
+        out << req;
+        auto bytes = out.str();
+
+        static auto &records = metrics_registry::instance().counter(
+            "capture_records_total", "Requests written to the traffic capture file.");
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        if (!file_)
+            return;
+        if (written_ + 12 + bytes.size() > max_bytes_)
+        {
+            std::cerr << "capture: " << path_ << " reached its size cap, capture stopped\n";
+            return stop();
+        }
+        std::uint64_t offset = std::max<std::int64_t>((arrived - start_).count(), 0);
+        auto size = static_cast<std::uint32_t>(bytes.size());
+        std::fwrite(&offset, sizeof offset, 1, file_);
+        std::fwrite(&size, sizeof size, 1, file_);
+        std::fwrite(bytes.data(), 1, bytes.size(), file_);
+        // The server has no orderly shutdown; keep the file whole on disk.
+        std::fflush(file_);
+        written_ += 12 + bytes.size();
+        records++;
+    }
+
+private:
+    void stop()
+    {
+        sample_ = 0;
+        if (file_)
+            std::fclose(file_);
+        file_ = nullptr;
+    }
+};
+
+// ---------------------------
+// SAMPLING PROFILER
+// ---------------------------
+// On-CPU sampling of the I/O threads for the `profile` handler. Each enrolled
+// thread gets a POSIX timer on its own CPU clock that sends it SIGPROF every
+// 1/hz seconds of CPU time, so idle threads cost nothing and samples are
+// proportional to where cores go. The signal handler only walks the frame
+// pointer chain of the interrupted context into a preallocated buffer;
+// symbolising and folding happen afterwards on the requesting thread.
+// Complete, named stacks need -fno-omit-frame-pointer -rdynamic.
+class sampling_profiler
+{
+    static constexpr int max_depth = 64;
+    static constexpr std::size_t max_samples = 1 << 16;
+
+    struct sample
+    {
+        int thread;
+        int depth;
+        std::uintptr_t pcs[max_depth]; // leaf first
+    };
+
+    struct thread_info
+    {
+        int index;
+        pid_t tid;
+        clockid_t clock;
+    };
+
+    profiled_mutex mutex_{"profiler"}; // guards threads_
+    profiled_mutex running_{"profile_run"}; // one profile at a time
+    std::vector<thread_info> threads_;
+    std::unique_ptr<sample[]> samples_; // kept between runs, grown as needed
+    std::size_t allocated_ = 0;
+    std::size_t capacity_ = 0;
+    std::atomic<std::size_t> next_{0};
+    std::atomic<bool> active_{false};
+    std::atomic<int> handlers_{0}; // signal handlers that may be writing a sample
+
+    // The calling thread's enrolment, read by the signal handler.
+    static thread_local int thread_index_;
+    static thread_local std::uintptr_t stack_low_, stack_high_;
+
+    sampling_profiler()
+    {
+        struct sigaction sa = {};
+        sa.sa_sigaction = on_signal;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        ::sigaction(SIGPROF, &sa, nullptr);
+    }
+
+    static void on_signal(int, siginfo_t *, void *context)
+    {
+        auto &p = instance();
+        // Counted before active_ is read (both seq_cst), so once profile()
+        // has cleared active_ and seen no handlers, none can still write.
+        struct counted
+        {
+            std::atomic<int> &handlers;
+            ~counted() { handlers.fetch_sub(1); }
+        } in_handler{p.handlers_};
+        p.handlers_.fetch_add(1);
+        if (!p.active_.load() || thread_index_ < 0)
+            return;
+        auto i = p.next_.fetch_add(1, std::memory_order_relaxed);
+        if (i >= p.capacity_)
+            return; // counted as dropped
+
+        auto &s = p.samples_[i];
+        auto *uc = static_cast<ucontext_t *>(context);
+#if defined(__x86_64__)
+        std::uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+        std::uintptr_t fp = uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+        std::uintptr_t pc = uc->uc_mcontext.pc;
+        std::uintptr_t fp = uc->uc_mcontext.regs[29];
+#else
+        std::uintptr_t pc = 0, fp = 0;
+        (void)uc;
+#endif
+        int depth = 0;
+        s.pcs[depth++] = pc;
+        // Each frame holds the caller's frame pointer and the return address.
+        // Code built without frame pointers leaves anything in the register,
+        // so the walk stops at the first value outside this thread's stack.
+        while (depth < max_depth && fp >= stack_low_ && fp + 2 * sizeof(std::uintptr_t) <= stack_high_ &&
+               fp % sizeof(std::uintptr_t) == 0)
+        {
+            auto *frame = reinterpret_cast<const std::uintptr_t *>(fp);
+            if (!frame[1])
+                break;
+            s.pcs[depth++] = frame[1];
+            if (frame[0] <= fp)
+                break; // callers live higher up the stack
+            fp = frame[0];
+        }
+        s.thread = thread_index_;
+        s.depth = depth;
+    }
+
+    // "function" demangled, or "library+0xoffset" without a symbol.
+    static std::string symbol(std::uintptr_t at)
+    {
+        Dl_info info;
+        std::ostringstream out;
+        if (!::dladdr(reinterpret_cast<void *>(at), &info))
+        {
+            out << "0x" << std::hex << at;
+            return out.str();
+        }
+        if (info.dli_sname)
+        {
+            int status = 0;
+            std::unique_ptr<char, void (*)(void *)> demangled(
+                abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), std::free);
+            return status == 0 ? demangled.get() : info.dli_sname;
+        }
+        std::string file = info.dli_fname ? info.dli_fname : "?";
+        out << file.substr(file.rfind('/') + 1) << "+0x" << std::hex << at - reinterpret_cast<std::uintptr_t>(info.dli_fbase);
+        return out.str();
+    }
+
+public:
+    static sampling_profiler &instance()
+    {
+        static sampling_profiler profiler;
+        return profiler;
+    }
+
+    // Called by each I/O thread as it starts.
+    void enroll(int index)
+    {
+        pthread_attr_t attr;
+        void *stack;
+        std::size_t size;
+        if (::pthread_getattr_np(::pthread_self(), &attr) != 0)
+            return;
+        bool known = ::pthread_attr_getstack(&attr, &stack, &size) == 0;
+        ::pthread_attr_destroy(&attr);
+        clockid_t clock;
+        if (!known || ::pthread_getcpuclockid(::pthread_self(), &clock) != 0)
+            return;
+        stack_low_ = reinterpret_cast<std::uintptr_t>(stack);
+        stack_high_ = stack_low_ + size;
+        thread_index_ = index;
+        std::lock_guard<profiled_mutex> lock(mutex_);
+        threads_.push_back({index, static_cast<pid_t>(::syscall(SYS_gettid)), clock});
+    }
+
+    // Samples for `duration` and returns folded stacks, one
+    // "io-N;outer;...;leaf count" line per distinct stack. False if another
+    // profile is running.
+    bool profile(std::chrono::milliseconds duration, int hz, std::string &folded, std::size_t &dropped)
+    {
+        std::unique_lock<profiled_mutex> busy(running_, std::try_to_lock);
+        if (!busy)
+            return false;
+        std::vector<thread_info> threads;
+        {
+            std::lock_guard<profiled_mutex> lock(mutex_);
+            threads = threads_;
+        }
+
+        capacity_ = std::min<std::size_t>(max_samples, threads.size() * hz * (duration.count() / 1000.0 + 1));
+        if (capacity_ > allocated_)
+        {
+            samples_.reset(new sample[capacity_]);
+            allocated_ = capacity_;
+        }
+        next_ = 0;
+        active_.store(true);
+
+        std::vector<timer_t> timers;
+        for (auto &t : threads)
+        {
+            sigevent ev = {};
+            ev.sigev_notify = SIGEV_THREAD_ID;
+            ev.sigev_signo = SIGPROF;
+            ev._sigev_un._tid = t.tid;
+            timer_t timer;
+            if (::timer_create(t.clock, &ev, &timer) != 0)
+                continue;
+            itimerspec period = {};
+            period.it_interval.tv_nsec = period.it_value.tv_nsec = 1000000000L / hz;
+            ::timer_settime(timer, 0, &period, nullptr);
+            timers.push_back(timer);
+        }
+        std::this_thread::sleep_for(duration);
+        active_.store(false);
+        for (auto timer : timers)
+            ::timer_delete(timer);
+        // Wait out handlers still writing a sample on other threads, however
+        // long they were preempted.
+        while (handlers_.load() != 0)
+            std::this_thread::yield();
+
+        auto taken = std::min(next_.load(), capacity_);
+        dropped = next_.load() - taken;
+        std::unordered_map<std::uintptr_t, std::string> names;
+        std::map<std::string, std::size_t> stacks;
+        for (std::size_t i = 0; i < taken; i++)
+        {
+            auto &s = samples_[i];
+            std::string stack = "io-" + std::to_string(s.thread);
+            for (int d = s.depth - 1; d >= 0; d--)
+            {
+                // Return addresses point past the call; look them up one
+                // byte back so they land inside the calling function.
+                auto at = d > 0 ? s.pcs[d] - 1 : s.pcs[d];
+                auto it = names.find(at);
+                if (it == names.end())
+                    it = names.emplace(at, symbol(at)).first;
+                stack += ';';
+                stack += it->second;
+            }
+            stacks[stack]++;
+        }
+
+        folded.clear();
+        for (auto &s : stacks)
+            folded += s.first + " " + std::to_string(s.second) + "\n";
+        return true;
+    }
+};
+
+thread_local int sampling_profiler::thread_index_ = -1;
+thread_local std::uintptr_t sampling_profiler::stack_low_ = 0;
+thread_local std::uintptr_t sampling_profiler::stack_high_ = 0;
+
+// ---------------------------
+// HANDLERS
+// ---------------------------
+using handler_factory = std::function<handler_fn(const std::vector<std::string> &args)>;
+
+const char *content_type_for(const std::string &path)
+{
+    static const std::pair<const char *, const char *> types[] = {
+        {".html", "text/html"}, {".css", "text/css"}, {".js", "application/javascript"},
+        {".json", "application/json"}, {".txt", "text/plain"}, {".svg", "image/svg+xml"},
+        {".png", "image/png"}, {".jpg", "image/jpeg"}, {".gif", "image/gif"},
+        {".wasm", "application/wasm"}};
+    for (auto &t : types)
+    {
+        auto n = std::strlen(t.first);
+        if (path.size() >= n && path.compare(path.size() - n, n, t.first) == 0)
+            return t.second;
+    }
+    return "application/octet-stream";
+}
+
+// Value of `name` in the target's query string, or `fallback`.
+long query_number(boost::beast::string_view target, const std::string &name, long fallback)
+{
+    auto query = target.find('?');
+    if (query == boost::beast::string_view::npos)
+        return fallback;
+    std::istringstream parts(std::string(target.substr(query + 1)));
+    for (std::string part; std::getline(parts, part, '&');)
+    {
+        if (part.compare(0, name.size() + 1, name + "=") == 0)
+            return std::strtol(part.c_str() + name.size() + 1, nullptr, 10);
+    }
+    return fallback;
+}
+
+// Whether an Accept-Encoding value lists gzip without q=0.
+bool accepts_gzip(boost::beast::string_view accept_encoding)
+{
+    std::istringstream codings{std::string(accept_encoding)};
+    for (std::string coding; std::getline(codings, coding, ',');)
+    {
+        coding.erase(std::remove(coding.begin(), coding.end(), ' '), coding.end());
+        auto params = coding.find(';');
+        if (!boost::beast::iequals(coding.substr(0, params), "gzip"))
+            continue;
+        auto q = coding.find("q=", params);
+        return q == std::string::npos || std::strtod(coding.c_str() + q + 2, nullptr) > 0;
+    }
+    return false;
+}
+
+// gzip at the fastest level: scrapes are frequent and the text compresses
+// well anyway. False if zlib fails.
+bool gzip_compress(const std::string &in, std::string &out)
+{
+    z_stream z{};
+    if (deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out.resize(deflateBound(&z, in.size()));
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    z.avail_in = static_cast<uInt>(in.size());
+    z.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    z.avail_out = static_cast<uInt>(out.size());
+    auto rc = deflate(&z, Z_FINISH);
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return rc == Z_STREAM_END;
+}
+
+// Resolves the request path below `root`, refusing anything that climbs out
+// of it, and hands back the open file for the session to sendfile().
+reply serve_file(const std::string &root, boost::beast::string_view target)
+{
+    auto query = target.find('?');
+    if (query != boost::beast::string_view::npos)
+        target = target.substr(0, query);
+
+    std::string path = root;
+    for (std::size_t pos = 0; pos < target.size();)
+    {
+        auto end = target.find('/', pos);
+        if (end == boost::beast::string_view::npos)
+            end = target.size();
+        auto segment = target.substr(pos, end - pos);
+        if (segment == "..")
+            return reply{http::status::forbidden, "", "Forbidden\n", {}, nullptr};
+        if (!segment.empty() && segment != ".")
+            path.append("/").append(segment.data(), segment.size());
+        pos = end + 1;
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st = {};
+    if (fd < 0 || ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (fd >= 0)
+            ::close(fd);
+        return reply{http::status::not_found, "", "Not Found", {}, nullptr};
+    }
+
+    // Files are sent front to back: ask for the larger readahead window.
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    reply r;
+    r.content_type = content_type_for(path);
+    r.file = std::make_shared<const file_source>(fd, static_cast<std::uint64_t>(st.st_size));
+    return r;
+}
+
+// The latest load report, pre-serialised by the load monitor once per tick
+// for the load header and the `load` handler.
+struct load_report
+{
+    std::string header; // ORCA endpoint-load-metrics TEXT format
+    std::string body;   // the same as JSON
+};
+
+rcu_ptr<load_report> &current_load()
+{
+    static rcu_ptr<load_report> report(std::make_unique<load_report>(
+        load_report{"TEXT application_utilization=0", "{\"application_utilization\":0}\n"}));
+    return report;
+}
+
+const std::unordered_map<std::string, handler_factory> &builtin_handlers()
+{
+    static const std::unordered_map<std::string, handler_factory> handlers = {
+        {"hello", [](const std::vector<std::string> &) -> handler_fn
+         {
+             return [](const request_context &)
+             { return reply{http::status::ok, "", "hello\n", {}}; };
+         }},
+        {"headers", [](const std::vector<std::string> &) -> handler_fn
+         {
+             return [](const request_context &ctx)
+             {
+                 reply r;
+                 for (auto &h : ctx.req.base())
+                 {
+                     r.body += std::string(h.name_string()) + ": " + std::string(h.value()) + "\n";
+                 }
+                 return r;
+             };
+         }},
+        {"metrics", [](const std::vector<std::string> &) -> handler_fn
+         {
+             return [](const request_context &ctx)
+             {
+                 auto &metrics = metrics_registry::instance();
+                 static auto &cost = metrics.histogram(
+                     "metrics_scrape_duration_seconds", "Time to render and compress the metrics exposition.", "",
+                     latency_buckets(), 1e-9);
+                 static auto &identity_bytes = metrics.counter(
+                     "metrics_scrape_bytes_total", "Bytes of metrics exposition sent.", "encoding=\"identity\"");
+                 static auto &gzip_bytes = metrics.counter(
+                     "metrics_scrape_bytes_total", "Bytes of metrics exposition sent.", "encoding=\"gzip\"");
+
+                 auto start = tsc_clock::now();
+                 reply r{http::status::ok, "text/plain; version=0.0.4", metrics.render(), {}};
+                 std::string compressed;
+                 if (accepts_gzip(ctx.req[http::field::accept_encoding]) && gzip_compress(r.body, compressed))
+                 {
+                     r.body = std::move(compressed);
+                     r.headers.emplace_back("Content-Encoding", "gzip");
+                     gzip_bytes += r.body.size();
+                 }
+                 else
+                     identity_bytes += r.body.size();
+                 r.headers.emplace_back("Vary", "Accept-Encoding");
+                 cost.observe((tsc_clock::now() - start).count());
+                 return r;
+             };
+         }},
+        // route /load load -- the latest load report, for balancers that poll
+        {"load", [](const std::vector<std::string> &) -> handler_fn
+         {
+             return [](const request_context &)
+             {
+                 rcu_domain::read_guard guard;
+                 return reply{http::status::ok, "application/json", current_load().load()->body, {}};
+             };
+         }},
+        // route /assets/* static <root> -- serves <root> + request path
+        {"static", [](const std::vector<std::string> &args) -> handler_fn
+         {
+             if (args.size() != 1)
+                 throw std::runtime_error("usage: static <root directory>");
+             return [root = args[0]](const request_context &ctx)
+             {
+                 return serve_file(root, ctx.req.target());
+             };
+         }},
+        // route /admin/profile profile pool=admin -- samples the I/O threads
+        // for ?seconds=N (default 10) at ?hz=N (default 99) and replies with
+        // folded stacks. It blocks for the whole run, hence the pool.
+        {"profile", [](const std::vector<std::string> &) -> handler_fn
+         {
+             return [](const request_context &ctx)
+             {
+                 auto seconds = std::clamp(query_number(ctx.req.target(), "seconds", 10), 1L, 60L);
+                 auto hz = std::clamp(query_number(ctx.req.target(), "hz", 99), 1L, 1000L);
+                 std::string folded;
+                 std::size_t dropped = 0;
+                 if (!sampling_profiler::instance().profile(std::chrono::seconds(seconds), static_cast<int>(hz),
+                                                            folded, dropped))
+                     return reply{http::status::conflict, "", "A profile is already running\n", {}};
+                 reply r{http::status::ok, "text/plain", std::move(folded), {}};
+                 r.headers.emplace_back("X-Profile-Dropped", std::to_string(dropped));
+                 return r;
+             };
+         }},
+        // route /admin/locks locks -- wait and hold times per lock site;
+        // ?reset=1 zeroes them after the reply
+        {"locks", [](const std::vector<std::string> &) -> handler_fn
+         {
+             return [](const request_context &ctx)
+             {
+                 bool reset = query_number(ctx.req.target(), "reset", 0) != 0;
+                 return reply{http::status::ok, "text/plain", lock_registry::instance().render(reset), {}};
+             };
+         }},
+        // route /path text "body" -- replies with a fixed body
+        {"text", [](const std::vector<std::string> &args) -> handler_fn
+         {
+             std::string body;
+             for (auto &a : args)
+                 body += (body.empty() ? "" : " ") + a;
+             return [body](const request_context &)
+             { return reply{http::status::ok, "", body, {}}; };
+         }},
+    };
+    return handlers;
+}
+
+// ---------------------------
+// HANDLER MODULES
+// ---------------------------
+// A shared library loaded through the C ABI in http_module.h. Every handler
+// built from it holds a shared_ptr to it, so the library is only finalised and
+// closed once the last route snapshot and in-flight request using it are gone.
+struct loaded_module
+{
+    std::string name;
+    std::string path;
+    struct stat file = {}; // identity of the file this copy was loaded from
+    void *library = nullptr;
+    void *state = nullptr;
+    http_module_fini_fn fini = nullptr;
+
+    struct entry
+    {
+        http_module_handler fn;
+        void *user_data;
+    };
+    std::unordered_map<std::string, entry> handlers;
+
+    ~loaded_module()
+    {
+        if (fini)
+            fini(state);
+        if (library)
+            dlclose(library);
+    }
+};
+
+struct http_module_registrar
+{
+    loaded_module *module;
+};
+
+struct http_module_response
+{
+    reply *out;
+    const request_context *ctx;
+};
+
+const http_module_host &module_host()
+{
+    static const http_module_host host = {
+        HTTP_MODULE_ABI_VERSION,
+        [](http_module_registrar *reg, const char *name, http_module_handler fn, void *user_data)
+        {
+            if (!reg || !name || !fn || !reg->module->handlers.emplace(name, loaded_module::entry{fn, user_data}).second)
+                return -1;
+            return 0;
+        },
+        [](http_module_response *res, int status)
+        { res->out->status = static_cast<http::status>(status); },
+        [](http_module_response *res, const char *name, std::size_t name_size, const char *value, std::size_t value_size)
+        {
+            std::string n(name, name_size);
+            if (boost::beast::iequals(n, "content-type"))
+                res->out->content_type.assign(value, value_size);
+            else
+                res->out->headers.emplace_back(std::move(n), std::string(value, value_size));
+        },
+        [](http_module_response *res, const char *data, std::size_t size)
+        { res->out->body.append(data, size); },
+        [](const char *message)
+        { std::cerr << "module: " << message << "\n"; },
+        [](http_module_response *res)
+        { return res->ctx->cancelled() ? 1 : 0; },
+    };
+    return host;
+}
+
+// dlopen() hands back the already loaded image for a path it has seen, so each
+// load goes through a private copy; that lets a module be rebuilt in place and
+// swapped in while requests still run on the old code.
+std::shared_ptr<loaded_module> load_module(const std::string &name, const std::string &path)
+{
+    auto m = std::make_shared<loaded_module>();
+    m->name = name;
+    m->path = path;
+    if (::stat(path.c_str(), &m->file) != 0)
+        throw std::runtime_error("module " + name + ": cannot stat " + path);
+
+    char copy[] = "/tmp/http-module-XXXXXX";
+    int out = ::mkstemp(copy);
+    if (out < 0)
+        throw std::runtime_error("module " + name + ": mkstemp failed");
+    {
+        std::ifstream src(path, std::ios::binary);
+        std::ofstream dst(copy, std::ios::binary);
+        dst << src.rdbuf();
+        ::close(out);
+        if (!src || !dst)
+        {
+            ::unlink(copy);
+            throw std::runtime_error("module " + name + ": cannot copy " + path);
+        }
+    }
+    m->library = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+    ::unlink(copy);
+    if (!m->library)
+        throw std::runtime_error("module " + name + ": " + dlerror());
+
+    auto abi = reinterpret_cast<http_module_abi_fn>(dlsym(m->library, HTTP_MODULE_ABI_SYMBOL));
+    auto init = reinterpret_cast<http_module_init_fn>(dlsym(m->library, HTTP_MODULE_INIT_SYMBOL));
+    if (!abi || !init)
+        throw std::runtime_error("module " + name + ": missing " HTTP_MODULE_ABI_SYMBOL " or " HTTP_MODULE_INIT_SYMBOL);
+    if (abi() < 1 || abi() > HTTP_MODULE_ABI_VERSION)
+        throw std::runtime_error("module " + name + ": ABI version " + std::to_string(abi()) +
+                                 ", server supports 1 to " + std::to_string(HTTP_MODULE_ABI_VERSION));
+
+    http_module_registrar registrar{m.get()};
+    if (init(&module_host(), &registrar, &m->state) != 0)
+        throw std::runtime_error("module " + name + ": init failed");
+    m->fini = reinterpret_cast<http_module_fini_fn>(dlsym(m->library, HTTP_MODULE_FINI_SYMBOL));
+
+    std::cout << "module: loaded " << name << " from " << path << " (" << m->handlers.size() << " handlers)\n";
+    return m;
+}
+
+// Reuses the module from the running snapshot when its file is unchanged so a
+// reload keeps its warm state; otherwise loads the new build next to it.
+std::shared_ptr<loaded_module> find_or_load_module(const std::string &name, const std::string &path)
+{
+    std::shared_ptr<loaded_module> current;
+    {
+        rcu_domain::read_guard guard;
+        auto &modules = active_config().load()->modules;
+        auto it = modules.find(name);
+        if (it != modules.end())
+            current = it->second;
+    }
+
+    struct stat st = {};
+    if (current && current->path == path && ::stat(path.c_str(), &st) == 0 &&
+        st.st_ino == current->file.st_ino && st.st_mtim.tv_sec == current->file.st_mtim.tv_sec &&
+        st.st_mtim.tv_nsec == current->file.st_mtim.tv_nsec && st.st_size == current->file.st_size)
+        return current;
+    return load_module(name, path);
+}
+
+handler_fn module_handler(std::shared_ptr<loaded_module> module, const std::string &name)
+{
+    auto it = module->handlers.find(name);
+    if (it == module->handlers.end())
+        throw std::runtime_error("module " + module->name + " has no handler '" + name + "'");
+    auto entry = it->second;
+
+    return [module, entry](const request_context &ctx)
+    {
+        auto &req = ctx.req;
+        std::vector<http_module_string> names, values;
+        for (auto &h : req.base())
+        {
+            names.push_back({h.name_string().data(), h.name_string().size()});
+            values.push_back({h.value().data(), h.value().size()});
+        }
+        http_module_request in = {
+            {req.method_string().data(), req.method_string().size()},
+            {req.target().data(), req.target().size()},
+            {req.body().data(), req.body().size()},
+            names.size(),
+            names.data(),
+            values.data(),
+            ctx.deadline == deadline_clock::time_point::max() ? -1 : ctx.remaining().count(),
+        };
+
+        reply r;
+        http_module_response out{&r, &ctx};
+        if (entry.fn(entry.user_data, &in, &out) != 0)
+            return reply{http::status::internal_server_error, "", "Internal Server Error", {}};
+        return r;
+    };
+}
+
+// Like modules, a pool whose settings did not change survives a reload, so
+// its threads and queued work are not disturbed.
+std::shared_ptr<exec_pool> find_or_create_pool(const std::string &name, int threads, std::size_t max_queue)
+{
+    {
+        rcu_domain::read_guard guard;
+        auto &pools = active_config().load()->pools;
+        auto it = pools.find(name);
+        if (it != pools.end() && it->second->threads == threads && it->second->max_queue() == max_queue)
+            return it->second;
+    }
+    return std::make_shared<exec_pool>(name, threads, max_queue);
+}
+
+// Likewise a route's bulkhead, keyed by route path: a fresh one would start
+// with nothing running while the old one's requests still run, letting the
+// route exceed its limit for as long as they last.
+std::shared_ptr<bulkhead> find_or_create_bulkhead(const std::string &path, std::size_t limit, std::size_t max_waiting,
+                                                  std::shared_ptr<exec_pool> pool)
+{
+    {
+        rcu_domain::read_guard guard;
+        auto &routes = active_config().load()->routes;
+        auto it = routes.find(path);
+        if (it != routes.end())
+        {
+            auto &b = it->second->isolation;
+            if (b && b->limit == limit && b->max_waiting == max_waiting && b->pool == pool)
+                return b;
+        }
+    }
+    return std::make_shared<bulkhead>(limit, max_waiting, std::move(pool));
+}
+
+// Splits `key=value` words off a directive's arguments.
+std::unordered_map<std::string, std::string> take_options(std::vector<std::string> &args)
+{
+    std::unordered_map<std::string, std::string> options;
+    auto it = args.begin();
+    while (it != args.end())
+    {
+        auto eq = it->find('=');
+        if (eq == std::string::npos || eq == 0)
+        {
+            ++it;
+            continue;
+        }
+        options[it->substr(0, eq)] = it->substr(eq + 1);
+        it = args.erase(it);
+    }
+    return options;
+}
+
+std::size_t option_size(std::unordered_map<std::string, std::string> &options, const std::string &key,
+                        std::size_t fallback)
+{
+    auto it = options.find(key);
+    if (it == options.end())
+        return fallback;
+    auto value = std::stoul(it->second);
+    options.erase(it);
+    return value;
+}
+
+// Time from a fully read request to its last response byte being handed to
+// the kernel, per route; requests that match no route are route="".
+metric_histogram &request_latency(const std::string &route_path)
+{
+    return metrics_registry::instance().histogram(
+        "http_request_duration_seconds", "Time from a complete request to the last byte of its response.",
+        "route=\"" + route_path + "\"", latency_buckets(), 1e-9);
+}
+
+// On-CPU time of the calling thread in nanoseconds. Time spent blocked or
+// descheduled does not count, so it measures what a handler costs in cores
+// rather than how long it took.
+std::int64_t thread_cpu_ns()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Handler names are either a built-in ("hello") or <module>.<handler> for a
+// module declared earlier in the same config. Routes take `pool=<name>`,
+// `limit=<concurrent>` and `queue=<waiting>` to isolate them and
+// `priority=<class>` to be served ahead of (or after) other routes;
+// `budget_ms=N` bounds how long a request may take before it is dropped and
+// `cache_ms=N` keeps successful GET replies for that long.
+std::shared_ptr<const route> make_route(const config_snapshot &snapshot, const std::string &path,
+                                        const std::string &name, std::vector<std::string> args)
+{
+    auto r = std::make_shared<route>();
+    r->path = path;
+    r->handler_name = name;
+    r->latency = &request_latency(path);
+    auto &metrics = metrics_registry::instance();
+    r->cpu = &metrics.counter("http_handler_cpu_seconds_total", "CPU time spent in each route's handler.",
+                              "route=\"" + path + "\"", 1e-9);
+    r->calls = &metrics.counter("http_handler_calls_total", "Handler runs per route (cache hits run none).",
+                                "route=\"" + path + "\"");
+
+    auto options = take_options(args);
+    std::shared_ptr<exec_pool> pool;
+    auto pool_name = options.find("pool");
+    if (pool_name != options.end())
+    {
+        auto it = snapshot.pools.find(pool_name->second);
+        if (it == snapshot.pools.end())
+            throw std::runtime_error("unknown pool '" + pool_name->second + "'");
+        pool = it->second;
+        options.erase(pool_name);
+    }
+    auto priority = options.find("priority");
+    if (priority != options.end())
+    {
+        if (!parse_priority(priority->second, r->priority))
+            throw std::runtime_error("unknown priority class '" + priority->second + "'");
+        options.erase(priority);
+    }
+    r->budget = std::chrono::milliseconds(option_size(options, "budget_ms", 0));
+    r->cache_ttl = std::chrono::milliseconds(option_size(options, "cache_ms", 0));
+    auto limit = option_size(options, "limit", 0);
+    auto waiting = option_size(options, "queue", 0);
+    if (!options.empty())
+        throw std::runtime_error("unknown route option '" + options.begin()->first + "'");
+    if (pool || limit)
+        r->isolation = find_or_create_bulkhead(path, limit, waiting, std::move(pool));
+
+    auto dot = name.find('.');
+    if (dot != std::string::npos)
+    {
+        auto m = snapshot.modules.find(name.substr(0, dot));
+        if (m == snapshot.modules.end())
+            throw std::runtime_error("unknown module in handler '" + name + "'");
+        r->handler = module_handler(m->second, name.substr(dot + 1));
+        return r;
+    }
+
+    auto &handlers = builtin_handlers();
+    auto it = handlers.find(name);
+    if (it == handlers.end())
+        throw std::runtime_error("unknown handler '" + name + "'");
+    r->handler = it->second(args);
+    return r;
+}
+
+// The routes that used to be compiled into handle_request; used when no
+// config file is present.
+std::unique_ptr<config_snapshot> default_config()
+{
+    auto snapshot = std::make_unique<config_snapshot>();
+    // Not find_or_create_pool(): this runs while active_config() itself is
+    // being initialised.
+    snapshot->pools[file_io_pool] = std::make_shared<exec_pool>(file_io_pool, 4, 1024);
+    snapshot->routes["/hello"] = make_route(*snapshot, "/hello", "hello", {});
+    snapshot->routes["/headers"] = make_route(*snapshot, "/headers", "headers", {});
+    snapshot->routes["/metrics"] = make_route(*snapshot, "/metrics", "metrics", {});
+    return snapshot;
+}
+
+// Builds a complete snapshot from a config file. Throws on any error so a bad
+// edit never replaces a working table.
+std::unique_ptr<config_snapshot> load_config(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("cannot open " + path);
+
+    auto snapshot = std::make_unique<config_snapshot>();
+    auto &s = snapshot->settings;
+    std::string line;
+    int lineno = 0;
+
+    while (std::getline(in, line))
+    {
+        lineno++;
+        try
+        {
+            auto words = tokenize(line);
+            if (words.empty())
+                continue;
+
+            const std::string &key = words[0];
+            if (key == "route")
+            {
+                if (words.size() < 3)
+                    throw std::runtime_error("usage: route <path> <handler> [args...]");
+                std::vector<std::string> args(words.begin() + 3, words.end());
+                snapshot->routes[words[1]] = make_route(*snapshot, words[1], words[2], std::move(args));
+                continue;
+            }
+            if (key == "shed")
+            {
+                std::vector<std::string> args(words.begin() + 1, words.end());
+                auto options = take_options(args);
+                priority_class p;
+                if (args.size() != 1 || !parse_priority(args[0], p))
+                    throw std::runtime_error("usage: shed <class> inflight=N");
+                if (p == priority_class::critical)
+                    throw std::runtime_error("critical requests are never shed");
+                s.shed_inflight[static_cast<std::size_t>(p)] = option_size(options, "inflight", 0);
+                if (!options.empty())
+                    throw std::runtime_error("unknown shed option '" + options.begin()->first + "'");
+                continue;
+            }
+            if (key == "metrics_shm")
+            {
+                std::vector<std::string> args(words.begin() + 1, words.end());
+                auto options = take_options(args);
+                if (args.size() != 1)
+                    throw std::runtime_error("usage: metrics_shm <name>|off [interval_ms=N] [size_kb=N]");
+                s.metrics_shm = args[0] == "off" ? "" : (args[0][0] == '/' ? "" : "/") + args[0];
+                s.metrics_shm_interval =
+                    std::chrono::milliseconds(std::max<std::size_t>(option_size(options, "interval_ms", 1000), 10));
+                s.metrics_shm_size = std::max<std::size_t>(option_size(options, "size_kb", 1024), 4) * 1024;
+                if (!options.empty())
+                    throw std::runtime_error("unknown metrics_shm option '" + options.begin()->first + "'");
+                continue;
+            }
+            if (key == "capture")
+            {
+                std::vector<std::string> args(words.begin() + 1, words.end());
+                auto options = take_options(args);
+                if (args.size() != 1)
+                    throw std::runtime_error("usage: capture <file>|off [sample=N] [max_mb=N]");
+                s.capture_path = args[0] == "off" ? "" : args[0];
+                s.capture_sample = std::max<std::size_t>(option_size(options, "sample", 1), 1);
+                s.capture_max = option_size(options, "max_mb", 64) * 1024 * 1024;
+                if (!options.empty())
+                    throw std::runtime_error("unknown capture option '" + options.begin()->first + "'");
+                continue;
+            }
+            if (key == "peers")
+            {
+                std::vector<std::string> args(words.begin() + 1, words.end());
+                auto options = take_options(args);
+                auto self = options.find("self");
+                if (args == std::vector<std::string>{"off"})
+                {
+                    s.peers.clear();
+                    s.peer_self.clear();
+                    continue;
+                }
+                if (args.empty() || self == options.end())
+                    throw std::runtime_error("usage: peers <host:port>... self=<host:port> [timeout_ms=N] "
+                                             "[local_ms=N] [connections=N]");
+                if (std::find(args.begin(), args.end(), self->second) == args.end())
+                    throw std::runtime_error("peers: self=" + self->second + " is not in the list");
+                s.peers = args;
+                s.peer_self = self->second;
+                options.erase(self);
+                s.peer_timeout = std::chrono::milliseconds(option_size(options, "timeout_ms", 250));
+                s.peer_local = std::chrono::milliseconds(option_size(options, "local_ms", 1000));
+                s.peer_connections = option_size(options, "connections", 8);
+                if (!options.empty())
+                    throw std::runtime_error("unknown peers option '" + options.begin()->first + "'");
+                continue;
+            }
+            if (key == "load_score")
+            {
+                std::vector<std::string> args(words.begin() + 1, words.end());
+                auto options = take_options(args);
+                if (!args.empty())
+                    throw std::runtime_error(
+                        "usage: load_score [interval_ms=N] [half_life_ms=N] [in_flight=N] [lag_ms=N] [queue=N]");
+                s.load_interval =
+                    std::chrono::milliseconds(std::max<std::size_t>(option_size(options, "interval_ms", 250), 10));
+                s.load_half_life = std::chrono::milliseconds(option_size(options, "half_life_ms", 2000));
+                s.load_in_flight = std::max<std::size_t>(option_size(options, "in_flight", 256), 1);
+                s.load_lag = std::chrono::milliseconds(std::max<std::size_t>(option_size(options, "lag_ms", 50), 1));
+                s.load_queue = std::max<std::size_t>(option_size(options, "queue", 256), 1);
+                if (!options.empty())
+                    throw std::runtime_error("unknown load_score option '" + options.begin()->first + "'");
+                continue;
+            }
+            if (key == "pool")
+            {
+                std::vector<std::string> args(words.begin() + 1, words.end());
+                auto options = take_options(args);
+                if (args.size() != 1)
+                    throw std::runtime_error("usage: pool <name> [threads=N] [queue=N]");
+                int threads = static_cast<int>(option_size(options, "threads", 1));
+                auto max_queue = option_size(options, "queue", 1024);
+                if (!options.empty())
+                    throw std::runtime_error("unknown pool option '" + options.begin()->first + "'");
+                if (threads < 1)
+                    throw std::runtime_error("pool needs at least one thread");
+                snapshot->pools[args[0]] = find_or_create_pool(args[0], threads, max_queue);
+                continue;
+            }
+            if (key == "module")
+            {
+                if (words.size() != 3)
+                    throw std::runtime_error("usage: module <name> <path.so>");
+                if (words[1].find('.') != std::string::npos)
+                    throw std::runtime_error("module names cannot contain '.'");
+                snapshot->modules[words[1]] = find_or_load_module(words[1], words[2]);
+                continue;
+            }
+
+            if (words.size() < 2)
+                throw std::runtime_error("missing value for '" + key + "'");
+            if (key == "port")
+                s.port = static_cast<unsigned short>(std::stoi(words[1]));
+            else if (key == "threads")
+                s.threads = std::stoi(words[1]);
+            else if (key == "backend")
+            {
+                if (words[1] == "asio")
+                    s.backend = io_backend::asio;
+                else if (words[1] == "epoll")
+                    s.backend = io_backend::epoll;
+                else if (words[1] == "uring")
+                    s.backend = io_backend::uring;
+                else
+                    throw std::runtime_error("backend must be asio, epoll or uring");
+            }
+            else if (key == "memory_limit_mb")
+                s.memory_limit = static_cast<std::int64_t>(std::stoul(words[1])) * 1024 * 1024;
+            else if (key == "connection_memory_kb")
+                s.connection_memory = std::stoul(words[1]) * 1024;
+            else if (key == "coalesce")
+            {
+                static const char *kinds[body_kinds] = {"memory", "zerocopy", "file"};
+                static const char *modes[] = {"none", "writev", "more", "cork"};
+                std::size_t kind = 0, mode = 0;
+                while (kind < body_kinds && words[1] != kinds[kind])
+                    kind++;
+                while (words.size() == 3 && mode < 4 && words[2] != modes[mode])
+                    mode++;
+                if (words.size() != 3 || kind == body_kinds || mode == 4)
+                    throw std::runtime_error("usage: coalesce memory|zerocopy|file none|writev|more|cork");
+                if (mode == static_cast<std::size_t>(coalesce_mode::writev) && kind != 0)
+                    throw std::runtime_error("writev only applies to in-memory bodies");
+                s.coalesce[kind] = static_cast<coalesce_mode>(mode);
+            }
+            else if (key == "zerocopy_threshold_kb")
+                s.zerocopy_threshold = std::stoul(words[1]) * 1024;
+            else if (key == "lock_profiling")
+                s.lock_profiling = words[1] == "on";
+            else if (key == "cache_mb")
+                s.cache_capacity = std::stoul(words[1]) * 1024 * 1024;
+            else if (key == "pressure_psi")
+            {
+                if (words.size() != 3)
+                    throw std::runtime_error("usage: pressure_psi <low%> <high%>");
+                s.pressure_psi_low = std::stod(words[1]);
+                s.pressure_psi_high = std::stod(words[2]);
+            }
+            else if (key == "pressure_usage")
+            {
+                if (words.size() != 3)
+                    throw std::runtime_error("usage: pressure_usage <low> <high>");
+                s.pressure_usage_low = std::stod(words[1]);
+                s.pressure_usage_high = std::stod(words[2]);
+            }
+            else if (key == "keepalive_timeout_ms")
+                s.keepalive_timeout = std::chrono::milliseconds(std::stoul(words[1]));
+            else if (key == "header_timeout_ms")
+                s.header_timeout = std::chrono::milliseconds(std::stoul(words[1]));
+            else if (key == "min_data_rate")
+            {
+                std::vector<std::string> args(words.begin() + 1, words.end());
+                auto options = take_options(args);
+                if (args.size() != 1)
+                    throw std::runtime_error("usage: min_data_rate <bytes_per_s> [window_ms=N]");
+                s.min_data_rate = std::stoull(args[0]);
+                s.min_rate_window = std::chrono::milliseconds(std::max<std::size_t>(option_size(options, "window_ms", 5000), 1000));
+                if (!options.empty())
+                    throw std::runtime_error("unknown min_data_rate option '" + options.begin()->first + "'");
+            }
+            else if (key == "send_queue_kb")
+                s.send_queue = std::stoi(words[1]) * 1024;
+            else if (key == "busy_poll_us")
+                s.busy_poll = std::chrono::microseconds(std::stoul(words[1]));
+            else if (key == "busy_poll_socket_us")
+                s.busy_poll_socket = std::stoi(words[1]);
+            else if (key == "pressure_interval_ms")
+                s.pressure_interval = std::chrono::milliseconds(std::max(10ul, std::stoul(words[1])));
+            else if (key == "default_budget_ms")
+                s.default_budget = std::chrono::milliseconds(std::stoul(words[1]));
+            else if (key == "timeout_header")
+                s.timeout_header = words[1] == "off" ? "" : words[1];
+            else if (key == "priority_header")
+                s.priority_header = words[1] == "off" ? "" : words[1];
+            else if (key == "load_header")
+                s.load_header = words[1] == "off" ? "" : words[1];
+            else if (key == "server_name")
+            {
+                s.server_name = words[1];
+                for (std::size_t i = 2; i < words.size(); i++)
+                    s.server_name += " " + words[i];
+            }
+            else
+                throw std::runtime_error("unknown setting '" + key + "'");
+        }
+        catch (std::exception &e)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(lineno) + ": " + e.what());
+        }
+    }
+    if (!snapshot->pools.count(file_io_pool))
+        snapshot->pools[file_io_pool] = find_or_create_pool(file_io_pool, 4, 1024);
+    if (!s.peers.empty())
+        for (auto &r : snapshot->routes)
+            if (r.second->cache_ttl.count() && !(r.second->isolation && r.second->isolation->pool))
+                std::cerr << path << ": route " << r.first
+                          << " has cache_ms but no pool=, so its misses are not filled from peers\n";
+    return snapshot;
+}
+
+rcu_ptr<config_snapshot> &active_config()
+{
+    static rcu_ptr<config_snapshot> config(default_config());
+    return config;
+}
+
+// Pushes settings enforced outside the snapshot to where they live. Runs at
+// startup and after every reload.
+void apply_settings(const server_settings &s)
+{
+    static auto &connection_budget = metrics_registry::instance().gauge(
+        "memory_budget_bytes", "Configured memory budget, 0 = unlimited.", "scope=\"connection\"");
+    memory_budget::global().set_limit(s.memory_limit);
+    response_cache::instance().set_capacity(s.cache_capacity);
+    connection_budget = static_cast<std::int64_t>(s.connection_memory);
+    traffic_capture::instance().configure(s.capture_path, s.capture_sample, s.capture_max);
+    peer_cache::instance().configure(s);
+    lock_profiling = s.lock_profiling;
+}
+
+// ---------------------------
+// ROUTER
+// ---------------------------
+// Exact paths win; otherwise the longest "<prefix>/*" route covering the
+// path matches.
+std::shared_ptr<const route> find_route(boost::beast::string_view target)
+{
+    auto query = target.find('?');
+    if (query != boost::beast::string_view::npos)
+        target = target.substr(0, query);
+
+    rcu_domain::read_guard guard;
+    auto &routes = active_config().load()->routes;
+    std::string key(target);
+    auto it = routes.find(key);
+    while (it == routes.end())
+    {
+        if (key.empty() || key == "/*")
+            return nullptr;
+        auto slash = key.rfind('/', key.back() == '*' && key.size() >= 3 ? key.size() - 3 : std::string::npos);
+        if (slash == std::string::npos)
+            return nullptr;
+        key.replace(slash + 1, std::string::npos, "*");
+        it = routes.find(key);
+    }
+    return it->second;
+}
+
+// Requests between dispatch and the end of their response write, across all
+// sessions; drives priority shedding and load reports.
+std::atomic<std::size_t> requests_in_flight{0};
+
+// Responses completely handed to the kernel; load reports derive the request
+// rate from it.
+std::atomic<std::uint64_t> responses_completed{0};
+
+// The cache is keyed on the target alone, so a reply negotiated on request
+// headers (Vary, or an encoding such as /metrics' gzip) must not be kept.
+bool negotiated(const reply &r)
+{
+    for (auto &h : r.headers)
+        if (boost::beast::iequals(h.first, "Vary") || boost::beast::iequals(h.first, "Content-Encoding"))
+            return true;
+    return false;
+}
+
+// Runs the route's handler and keeps the reply if the route is cacheable;
+// a cacheable key owned by another peer is asked of that peer first.
+// Replies are shared rather than copied from here on, so a cached body is
+// written straight from the cache's buffer.
+std::shared_ptr<const reply> invoke(const route &r, const request_context &ctx)
+{
+    bool cacheable = r.cache_ttl.count() && ctx.req.method() == http::verb::get;
+    std::chrono::milliseconds keep{0};
+    if (cacheable)
+    {
+        if (auto filled = peer_cache::instance().fill(ctx, keep))
+        {
+            if (keep.count() && !negotiated(*filled))
+                response_cache::instance().insert(std::string(ctx.req.target()), filled,
+                                                  std::min(keep, r.cache_ttl));
+            return filled;
+        }
+    }
+
+    auto cpu_start = thread_cpu_ns();
+    auto out = std::make_shared<const reply>(r.handler(ctx));
+    *r.cpu += thread_cpu_ns() - cpu_start;
+    (*r.calls)++;
+    if (cacheable && out->status == http::status::ok && !negotiated(*out))
+        response_cache::instance().insert(std::string(ctx.req.target()), out, r.cache_ttl);
+    return out;
+}
+
+reply not_found()
+{
+    return reply{http::status::not_found, "", "Not Found", {}};
+}
+
+reply overloaded()
+{
+    return reply{http::status::service_unavailable, "", "Service Unavailable\n", {}};
+}
+
+reply rejected(http::status status)
+{
+    if (status == http::status::gateway_timeout)
+        return reply{status, "", "Deadline Exceeded\n", {}};
+    return overloaded();
+}
+
+// Serialises the status line and header fields for `r`; shared by both I/O
+// backends. The caller holds an rcu_domain::read_guard for `settings`.
+std::string response_header(const reply &r, unsigned version, bool keep_alive, const server_settings &settings)
+{
+    http::response<http::empty_body> res;
+    res.version(version);
+    res.keep_alive(keep_alive);
+    res.result(r.status);
+    res.set(http::field::server, settings.server_name);
+    if (!settings.load_header.empty())
+        res.set(settings.load_header, current_load().load()->header);
+    if (!r.content_type.empty())
+        res.set(http::field::content_type, r.content_type);
+    for (auto &h : r.headers)
+        res.set(h.first, h.second);
+    res.content_length(r.file ? r.file->size : r.body.size());
+
+    std::ostringstream out;
+    out << res.base();
+    return out.str();
+}
+
+// Parses a client timeout such as "250", "250ms" or "2s" (bare numbers are
+// milliseconds). Returns false for anything else.
+bool parse_timeout(boost::beast::string_view text, std::chrono::milliseconds &out)
+{
+    std::size_t digits = 0;
+    std::uint64_t value = 0;
+    while (digits < text.size() && digits < 12 && text[digits] >= '0' && text[digits] <= '9')
+        value = value * 10 + (text[digits++] - '0');
+    if (digits == 0)
+        return false;
+
+    auto unit = text.substr(digits);
+    if (unit.empty() || unit == "ms")
+        out = std::chrono::milliseconds(value);
+    else if (unit == "s")
+        out = std::chrono::seconds(value);
+    else
+        return false;
+    return true;
+}
+
+// ---------------------------
+// CONFIG RELOADER
+// ---------------------------
+// Rebuilds the config snapshot on SIGHUP or when the file changes on disk.
+// Parsing and handler construction run on the housekeeping thread so the I/O
+// threads only ever see the finished snapshot appear.
+class config_reloader
+{
+    boost::asio::signal_set signals_;
+    boost::asio::posix::stream_descriptor inotify_;
+    boost::asio::steady_timer debounce_;
+    boost::asio::steady_timer reclaim_;
+    std::string path_;
+    std::string file_name_;
+    std::array<char, 4096> events_;
+
+public:
+    config_reloader(boost::asio::io_context &ioc, std::string path)
+        : signals_(ioc, SIGHUP), inotify_(ioc), debounce_(ioc), reclaim_(ioc),
+          path_(std::move(path))
+    {
+        // Watch the directory rather than the file: editors and config
+        // management usually replace the file by rename.
+        auto slash = path_.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : path_.substr(0, slash + 1);
+        file_name_ = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0)
+            inotify_.assign(fd);
+        else
+        {
+            if (fd >= 0)
+                ::close(fd);
+            std::cerr << "config: inotify unavailable, reload with SIGHUP only\n";
+        }
+    }
+
+    void run()
+    {
+        wait_signal();
+        if (inotify_.is_open())
+            wait_inotify();
+    }
+
+private:
+    void wait_signal()
+    {
+        signals_.async_wait([this](boost::beast::error_code ec, int)
+                            {
+            if (ec)
+                return;
+            reload();
+            wait_signal(); });
+    }
+
+    void wait_inotify()
+    {
+        inotify_.async_read_some(boost::asio::buffer(events_),
+                                 [this](boost::beast::error_code ec, std::size_t n)
+                                 {
+            if (ec)
+                return;
+
+            bool ours = false;
+            for (std::size_t off = 0; off + sizeof(inotify_event) <= n;)
+            {
+                auto *ev = reinterpret_cast<const inotify_event *>(events_.data() + off);
+                if (ev->len && file_name_ == ev->name)
+                    ours = true;
+                off += sizeof(inotify_event) + ev->len;
+            }
+
+            // A save is often several events; reload once they settle.
+            if (ours)
+            {
+                debounce_.expires_after(std::chrono::milliseconds(50));
+                debounce_.async_wait([this](boost::beast::error_code ec)
+                                     {
+                    if (!ec)
+                        reload(); });
+            }
+            wait_inotify(); });
+    }
+
+    void reload()
+    {
+        std::unique_ptr<config_snapshot> next;
+        try
+        {
+            next = load_config(path_);
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << "config: reload failed, keeping current: " << e.what() << "\n";
+            return;
+        }
+
+        {
+            rcu_domain::read_guard guard;
+            auto &current = active_config().load()->settings;
+            if (current.port != next->settings.port || current.threads != next->settings.threads ||
+                current.backend != next->settings.backend || current.busy_poll != next->settings.busy_poll)
+                std::cerr << "config: port, threads, backend and busy_poll_us changes take effect on restart\n";
+        }
+
+        auto routes = next->routes.size();
+        auto settings = next->settings;
+        active_config().publish(std::move(next));
+        apply_settings(settings);
+        std::cout << "config: reloaded " << path_ << " (" << routes << " routes)\n";
+        schedule_reclaim();
+    }
+
+    // Readers that were mid-lookup during the swap pin the old snapshot for a
+    // few microseconds; retry until it is gone.
+    void schedule_reclaim()
+    {
+        if (active_config().reclaim() == 0)
+            return;
+        reclaim_.expires_after(std::chrono::milliseconds(10));
+        reclaim_.async_wait([this](boost::beast::error_code ec)
+                            {
+            if (!ec)
+                schedule_reclaim(); });
+    }
+};
+
+// ---------------------------
+// MEMORY PRESSURE MONITOR
+// ---------------------------
+// Samples the cgroup v2 memory controller (memory.pressure, memory.current,
+// memory.max) and turns it into a pressure ratio between 0 and 1: the worse
+// of PSI "some avg10" and usage against the limit, each scaled between its
+// configured low and high marks. The response cache shrinks in proportion,
+// and above one half freed heap is handed back to the kernel, so memory is
+// given up gradually well before the OOM killer would take all of it.
+class pressure_monitor
+{
+    boost::asio::steady_timer timer_;
+    std::string psi_path_;
+    std::string current_path_;
+    std::string max_path_;
+    double last_ = 0;
+
+    std::atomic<std::int64_t> &ratio_;
+    std::atomic<std::int64_t> &psi_some_;
+    std::atomic<std::int64_t> &current_;
+    std::atomic<std::int64_t> &max_;
+
+public:
+    explicit pressure_monitor(boost::asio::io_context &ioc)
+        : timer_(ioc),
+          ratio_(metrics_registry::instance().gauge("memory_pressure_ratio",
+                                                    "Memory pressure driving cache shrinking, 0 to 1.", "", 0.001)),
+          psi_some_(metrics_registry::instance().gauge("memory_psi_some_avg10",
+                                                       "cgroup memory PSI some avg10, percent.", "", 0.01)),
+          current_(metrics_registry::instance().gauge("cgroup_memory_current_bytes", "cgroup memory.current.")),
+          max_(metrics_registry::instance().gauge("cgroup_memory_max_bytes", "cgroup memory.max, 0 = no limit."))
+    {
+        std::string dir = "/sys/fs/cgroup";
+        std::ifstream self("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(self, line))
+            if (line.compare(0, 3, "0::") == 0)
+                dir += line.substr(3);
+
+        psi_path_ = dir + "/memory.pressure";
+        current_path_ = dir + "/memory.current";
+        max_path_ = dir + "/memory.max";
+        // Without a cgroup v2 memory controller, fall back to system-wide PSI.
+        if (!std::ifstream(psi_path_))
+            psi_path_ = "/proc/pressure/memory";
+        if (!std::ifstream(psi_path_) && !std::ifstream(current_path_))
+            std::cerr << "pressure: no PSI or cgroup v2 memory files, monitor disabled\n";
+    }
+
+    void run()
+    {
+        sample();
+    }
+
+private:
+    static bool read_number(const std::string &path, double &out)
+    {
+        std::ifstream in(path);
+        std::string word;
+        if (!(in >> word) || word == "max")
+            return false;
+        out = std::stod(word);
+        return true;
+    }
+
+    static double scale(double value, double low, double high)
+    {
+        if (value <= low)
+            return 0;
+        if (value >= high || high <= low)
+            return 1;
+        return (value - low) / (high - low);
+    }
+
+    void sample()
+    {
+        server_settings settings;
+        {
+            rcu_domain::read_guard guard;
+            settings = active_config().load()->settings;
+        }
+
+        double pressure = 0;
+
+        std::ifstream psi(psi_path_);
+        std::string kind, avg10;
+        if (psi >> kind >> avg10 && kind == "some" && avg10.compare(0, 6, "avg10=") == 0)
+        {
+            double some = std::stod(avg10.substr(6));
+            psi_some_ = static_cast<std::int64_t>(some * 100);
+            pressure = scale(some, settings.pressure_psi_low, settings.pressure_psi_high);
+        }
+
+        double current = 0, max = 0;
+        if (read_number(current_path_, current))
+            current_ = static_cast<std::int64_t>(current);
+        if (read_number(max_path_, max) && max > 0)
+        {
+            max_ = static_cast<std::int64_t>(max);
+            pressure = std::max(pressure, scale(current / max, settings.pressure_usage_low,
+                                                settings.pressure_usage_high));
+        }
+
+        // Shrink straight away, grow back slowly so a brief dip in pressure
+        // does not refill the cache only to evict it again.
+        pressure = std::max(pressure, last_ - 0.05);
+        if (pressure != last_)
+        {
+            response_cache::instance().set_pressure(pressure);
+            if (pressure >= 0.5 && pressure > last_)
+                malloc_trim(0);
+            last_ = pressure;
+        }
+        ratio_ = static_cast<std::int64_t>(pressure * 1000);
+
+        timer_.expires_after(settings.pressure_interval);
+        timer_.async_wait([this](boost::beast::error_code ec)
+                          {
+            if (!ec)
+                sample(); });
+    }
+};
+
+// ---------------------------
+// SHARED-MEMORY METRICS
+// ---------------------------
+// Publishes the metrics text into the segment described in metrics_shm.h
+// every metrics_shm interval, so metricsctl can scrape a server whose HTTP
+// port is saturated or wedged. Runs on the housekeeping thread; the
+// segment follows `metrics_shm` across reloads and is unlinked on exit.
+class metrics_publisher
+{
+    boost::asio::steady_timer timer_;
+    std::string name_; // mapped segment, empty = none
+    std::size_t capacity_ = 0;
+    metrics_shm_header *header_ = nullptr;
+    std::size_t mapped_ = 0;
+
+public:
+    explicit metrics_publisher(boost::asio::io_context &ioc) : timer_(ioc) {}
+
+    ~metrics_publisher()
+    {
+        unmap();
+    }
+
+    void run()
+    {
+        publish();
+    }
+
+private:
+    void unmap()
+    {
+        if (header_)
+        {
+            ::munmap(header_, mapped_);
+            ::shm_unlink(name_.c_str());
+        }
+        header_ = nullptr;
+        name_.clear();
+    }
+
+    void map(const std::string &name, std::size_t capacity)
+    {
+        unmap();
+        int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        auto size = sizeof(metrics_shm_header) + capacity;
+        void *at = MAP_FAILED;
+        if (fd >= 0 && ::ftruncate(fd, static_cast<off_t>(size)) == 0)
+            at = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (fd >= 0)
+            ::close(fd);
+        if (at == MAP_FAILED)
+        {
+            std::cerr << "metrics_shm: cannot map " << name << ": " << std::strerror(errno) << "\n";
+            return;
+        }
+
+        header_ = static_cast<metrics_shm_header *>(at);
+        mapped_ = size;
+        name_ = name;
+        capacity_ = capacity;
+        std::memset(header_, 0, sizeof *header_);
+        std::memcpy(header_->magic, METRICS_SHM_MAGIC, sizeof header_->magic);
+        header_->version = METRICS_SHM_VERSION;
+        header_->header_size = sizeof *header_;
+        header_->capacity = capacity;
+        header_->publisher_pid = static_cast<std::uint64_t>(::getpid());
+    }
+
+    void publish()
+    {
+        std::string name;
+        std::size_t capacity;
+        std::chrono::milliseconds interval;
+        {
+            rcu_domain::read_guard guard;
+            auto &settings = active_config().load()->settings;
+            name = settings.metrics_shm;
+            capacity = settings.metrics_shm_size;
+            interval = settings.metrics_shm_interval;
+        }
+        if (name != name_ || capacity != capacity_)
+        {
+            if (name.empty())
+                unmap();
+            else
+                map(name, capacity);
+        }
+
+        if (header_)
+        {
+            static auto &overflows = metrics_registry::instance().counter(
+                "metrics_shm_overflows_total", "Snapshots not published because they exceed metrics_shm size_kb.");
+            auto text = metrics_registry::instance().render();
+            if (text.size() > capacity_)
+                overflows++;
+            else
+            {
+                auto sequence = header_->sequence;
+                __atomic_store_n(&header_->sequence, sequence + 1, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_RELEASE);
+                std::memcpy(reinterpret_cast<char *>(header_) + header_->header_size, text.data(), text.size());
+                header_->length = text.size();
+                timespec now;
+                ::clock_gettime(CLOCK_REALTIME, &now);
+                header_->published_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+                __atomic_store_n(&header_->sequence, sequence + 2, __ATOMIC_RELEASE);
+            }
+        }
+
+        timer_.expires_after(interval);
+        timer_.async_wait([this](boost::beast::error_code ec)
+                          {
+            if (!ec)
+                publish(); });
+    }
+};
+
+// ---------------------------
+// SLOW CLIENTS
+// ---------------------------
+// glibc's tcp_info stops before the byte counters Linux keeps since 4.2; the
+// kernel fills in as much of this longer layout as it has.
+struct tcp_info_bytes : tcp_info
+{
+    std::uint64_t pacing_rate, max_pacing_rate, bytes_acked, bytes_received;
+};
+
+// Bytes the peer has acknowledged and bytes it has sent us on `fd`. False on
+// kernels without the counters.
+bool tcp_byte_counts(int fd, std::uint64_t &acked, std::uint64_t &received)
+{
+    tcp_info_bytes info = {};
+    socklen_t len = sizeof info;
+    if (::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0 || len < sizeof info)
+        return false;
+    acked = info.bytes_acked;
+    received = info.bytes_received;
+    return true;
+}
+
+// Whether this kernel has the counters, probed once on a fresh socket.
+bool tcp_byte_counts_available()
+{
+    static const bool available = []
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        std::uint64_t acked, received;
+        bool ok = fd >= 0 && tcp_byte_counts(fd, acked, received);
+        if (fd >= 0)
+            ::close(fd);
+        return ok;
+    }();
+    return available;
+}
+
+// TCP_NOTSENT_LOWAT: a socket stops taking more data, and stops reporting
+// writable, while `bytes` of it wait to be sent, so a client that stops
+// reading pins at most that much plus its receive window in the kernel.
+void set_send_queue(int fd, int bytes)
+{
+    if (bytes > 0)
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof bytes);
+}
+
+// Progress of a connection's current read or write, measured with the
+// kernel's counters so every send path (writev, sendfile, zerocopy, io_uring)
+// is covered without bookkeeping of its own. Both backends check it about
+// once a second against the header_timeout_ms and min_data_rate settings.
+// Without the counters only header_timeout_ms is enforced, timed from the
+// start of every read.
+class transfer_watch
+{
+public:
+    enum class phase
+    {
+        none,
+        reading,
+        writing
+    };
+
+private:
+    phase phase_ = phase::none;
+    bool body_ = false;    // reading: the header is in, the body is being timed
+    bool waiting_ = false; // reading: idle between requests, nothing received yet
+    std::chrono::steady_clock::time_point since_;
+    std::uint64_t mark_ = 0; // byte counter at since_
+
+    static std::uint64_t counter(int fd, phase p)
+    {
+        std::uint64_t acked = 0, received = 0;
+        tcp_byte_counts(fd, acked, received);
+        return p == phase::writing ? acked : received;
+    }
+
+    void restart(int fd)
+    {
+        since_ = std::chrono::steady_clock::now();
+        mark_ = counter(fd, phase_);
+    }
+
+public:
+    phase current() const { return phase_; }
+
+    // `until_first_byte` is for a kept-alive connection waiting for its next
+    // request with nothing buffered: the header is timed from the check that
+    // first sees a byte of it, as the idle wait has a timeout of its own.
+    void start(phase p, int fd, bool until_first_byte = false)
+    {
+        phase_ = p;
+        body_ = false;
+        waiting_ = p == phase::reading && until_first_byte && tcp_byte_counts_available();
+        if (p != phase::none)
+            restart(fd);
+    }
+
+    // Why the connection should be dropped, or nullptr. `header_done` says
+    // whether the request being read has a complete header.
+    const char *check(int fd, bool header_done, const server_settings &s)
+    {
+        if (phase_ == phase::none)
+            return nullptr;
+        if (waiting_)
+        {
+            auto count = counter(fd, phase_);
+            since_ = std::chrono::steady_clock::now();
+            waiting_ = count == mark_;
+            return nullptr;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - since_;
+        if (phase_ == phase::reading && !header_done)
+            return s.header_timeout.count() && elapsed > s.header_timeout ? "header_timeout" : nullptr;
+        if (phase_ == phase::reading && !body_)
+        {
+            // The body's rate is timed from the end of the header.
+            body_ = true;
+            restart(fd);
+            return nullptr;
+        }
+        // Judged per window rather than since the start, so a burst that
+        // fills the client's receive buffer does not pay for minutes of
+        // trickling afterwards.
+        if (!s.min_data_rate || elapsed < s.min_rate_window || !tcp_byte_counts_available())
+            return nullptr;
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+        auto count = counter(fd, phase_);
+        if (count - mark_ < s.min_data_rate * seconds)
+            return phase_ == phase::reading ? "request_rate" : "response_rate";
+        since_ = std::chrono::steady_clock::now();
+        mark_ = count;
+        return nullptr;
+    }
+};
+
+// Counts a connection dropped by transfer_watch.
+void count_slow_close(const char *reason)
+{
+    metrics_registry::instance()
+        .counter("slow_client_closes_total", "Connections closed for sending or reading too slowly.",
+                 std::string("reason=\"") + reason + "\"")++;
+}
+
+// ---------------------------
+// PER-SESSION CLASS
+// ---------------------------
+class session : public std::enable_shared_from_this<session>
+{
+    tcp::socket socket_;
+    boost::beast::flat_buffer buffer_;
+    boost::optional<http::request_parser<http::string_body>> parser_;
+    http::request<http::string_body> req_;
+    std::shared_ptr<const reply> reply_; // pinned until its bytes are sent
+    std::string header_;
+    bool zerocopy_enabled_ = false;
+    bool corked_ = false;
+    std::uint32_t zerocopy_sent_ = 0; // MSG_ZEROCOPY sends issued / reported done
+    std::uint32_t zerocopy_done_ = 0;
+    bool in_flight_ = false;
+    std::shared_ptr<cancellation> cancel_; // set while a handler runs off-thread
+    std::uint64_t generation_ = 0; // bumped when an off-thread request ends
+    bool watching_ = false;        // a watch_peer read is outstanding
+    bool read_after_watch_ = false; // do_read() once that read has completed
+    std::size_t connection_budget_;
+    std::int64_t charged_ = 0; // bytes this session has charged to memory_budget
+    boost::asio::steady_timer paused_;
+    boost::asio::steady_timer idle_; // closes a kept-alive connection nobody uses
+    boost::asio::steady_timer guard_; // runs watch_'s checks while a transfer is timed
+    transfer_watch watch_;
+    bool guarding_ = false;
+    bool keep_alive_ = false;
+    std::chrono::milliseconds keepalive_timeout_{0};
+    tsc_clock::time_point started_; // when the current request was read
+    metric_histogram *latency_ = nullptr;
+
+public:
+    explicit session(tcp::socket socket, std::size_t connection_budget)
+        : socket_(std::move(socket)), buffer_(connection_budget), connection_budget_(connection_budget),
+          paused_(socket_.get_executor()), idle_(socket_.get_executor()), guard_(socket_.get_executor()) {}
+
+    ~session()
+    {
+        if (in_flight_)
+            requests_in_flight--;
+        memory_budget::global().charge(-charged_);
+    }
+
+    void run()
+    {
+        do_read();
+    }
+
+private:
+    // Re-charges the memory budget with what this session holds right now:
+    // its read buffer, the parsed request and the response being written.
+    void account()
+    {
+        std::int64_t bytes = buffer_.capacity() + req_.target().size() + req_.body().size() + header_.size();
+        for (auto &h : req_.base())
+            bytes += h.name_string().size() + h.value().size() + 32;
+        if (reply_)
+            bytes += reply_->body.size();
+        memory_budget::global().charge(bytes - charged_);
+        charged_ = bytes;
+    }
+
+    void do_read()
+    {
+        auto self = shared_from_this();
+
+        // Backpressure: while the server is over its memory budget, leave new
+        // requests in the kernel's socket buffers instead of parsing them.
+        if (memory_budget::global().exhausted())
+        {
+            static auto &pauses = metrics_registry::instance().counter(
+                "memory_read_pauses_total", "Reads postponed because the memory budget was exhausted.");
+            pauses++;
+            paused_.expires_after(std::chrono::milliseconds(10));
+            paused_.async_wait([self](boost::beast::error_code ec)
+                               {
+                if (!ec)
+                    self->do_read(); });
+            return;
+        }
+
+        parser_.emplace();
+        parser_->body_limit(connection_budget_);
+        guard(transfer_watch::phase::reading, keep_alive_ && buffer_.size() == 0);
+
+        // idle_ only times the wait between requests: it stops at the next
+        // request's first byte, and header_timeout_ms and min_data_rate take
+        // over from there.
+        if (buffer_.size() > 0)
+            idle_.cancel();
+        else if (keep_alive_)
+            socket_.async_wait(tcp::socket::wait_read, [self](boost::beast::error_code ec)
+                               {
+                if (!ec)
+                    self->idle_.cancel(); });
+
+        http::async_read(socket_, buffer_, *parser_,
+                         [self](boost::beast::error_code ec, std::size_t)
+                         {
+                             self->idle_.cancel();
+                             self->watch_.start(transfer_watch::phase::none, -1);
+                             self->keep_alive_ = false;
+                             if (!ec)
+                             {
+                                 self->started_ = tsc_clock::now();
+                                 self->req_ = self->parser_->release();
+                                 self->keep_alive_ = self->req_.keep_alive();
+                                 traffic_capture::instance().record(self->req_, self->started_);
+                                 self->account();
+                                 return self->do_dispatch();
+                             }
+
+                             static auto &refused = metrics_registry::instance().counter(
+                                 "memory_rejections_total", "Requests refused for memory.",
+                                 "reason=\"connection_budget\"");
+                             if (ec == http::error::body_limit)
+                             {
+                                 refused++;
+                                 self->do_write(reply{http::status::payload_too_large, "", "Payload Too Large\n", {}});
+                             }
+                             else if (ec == http::error::header_limit || ec == http::error::buffer_overflow)
+                             {
+                                 refused++;
+                                 self->do_write(reply{http::status::request_header_fields_too_large, "",
+                                                      "Request Header Fields Too Large\n", {}});
+                             }
+                         });
+    }
+
+    // Starts timing a read or write and, unless it is already running, the
+    // once-a-second check that drops the connection if it is too slow.
+    void guard(transfer_watch::phase p, bool until_first_byte = false)
+    {
+        watch_.start(p, socket_.native_handle(), until_first_byte);
+        if (!guarding_)
+            arm_guard();
+    }
+
+    void arm_guard()
+    {
+        guarding_ = true;
+        auto self = shared_from_this();
+        guard_.expires_after(std::chrono::seconds(1));
+        guard_.async_wait([self](boost::beast::error_code ec)
+                          { self->on_guard(ec); });
+    }
+
+    void on_guard(boost::beast::error_code ec)
+    {
+        guarding_ = false;
+        if (ec || watch_.current() == transfer_watch::phase::none || !socket_.is_open())
+            return;
+        const char *reason;
+        {
+            rcu_domain::read_guard guard;
+            reason = watch_.check(socket_.native_handle(), parser_ && parser_->is_header_done(),
+                                  active_config().load()->settings);
+        }
+        if (!reason)
+            return arm_guard();
+        count_slow_close(reason);
+        watch_.start(transfer_watch::phase::none, -1);
+        // Pending operations complete with operation_aborted. With zerocopy
+        // sends unreported the socket is kept for on_written to reset.
+        if (zerocopy_done_ < zerocopy_sent_)
+        {
+            socket_.cancel(ec);
+            paused_.cancel();
+        }
+        else
+            socket_.close(ec);
+    }
+
+    // Classifies the request, sheds it if its class is over the in-flight
+    // threshold, then runs the handler inline or hands it to the route's
+    // bulkhead and picks the reply back up on this session's strand.
+    void do_dispatch()
+    {
+        auto route = find_route(req_.target());
+        if (!route)
+        {
+            static auto &unmatched = request_latency("");
+            latency_ = &unmatched;
+            return do_write(not_found());
+        }
+        latency_ = route->latency;
+
+        priority_class priority = route->priority;
+        std::size_t shed_at;
+        std::chrono::milliseconds budget = route->budget;
+        {
+            rcu_domain::read_guard guard;
+            auto &settings = active_config().load()->settings;
+            if (!settings.priority_header.empty())
+            {
+                auto it = req_.find(settings.priority_header);
+                if (it != req_.end())
+                    parse_priority(it->value(), priority);
+            }
+            shed_at = settings.shed_inflight[static_cast<std::size_t>(priority)];
+
+            if (budget.count() == 0)
+                budget = settings.default_budget;
+            std::chrono::milliseconds client;
+            if (!settings.timeout_header.empty())
+            {
+                auto it = req_.find(settings.timeout_header);
+                if (it != req_.end() && parse_timeout(it->value(), client) &&
+                    (budget.count() == 0 || client < budget))
+                    budget = client.count() ? client : std::chrono::milliseconds(-1); // "0": already late
+            }
+        }
+        if (shed_at && requests_in_flight.load(std::memory_order_relaxed) >= shed_at)
+            return do_write(overloaded());
+        if (priority != priority_class::critical && memory_budget::global().exhausted())
+        {
+            static auto &shed = metrics_registry::instance().counter(
+                "memory_rejections_total", "Requests refused for memory.", "reason=\"global_budget\"");
+            shed++;
+            return do_write(overloaded());
+        }
+
+        if (route->cache_ttl.count() && req_.method() == http::verb::get)
+        {
+            if (auto hit = response_cache::instance().find(std::string(req_.target())))
+                return do_write(std::move(hit));
+        }
+
+        request_context ctx{req_};
+        if (budget.count() != 0)
+            ctx.deadline = deadline_clock::now() + budget;
+        if (ctx.expired())
+            return do_write(rejected(http::status::gateway_timeout));
+
+        requests_in_flight++;
+        in_flight_ = true;
+
+        if (!route->isolation)
+            return do_write(invoke(*route, ctx));
+
+        auto self = shared_from_this();
+        cancel_ = std::make_shared<cancellation>();
+        route->isolation->submit(pool_job{
+            [self, route, deadline = ctx.deadline]
+            {
+                request_context ctx{self->req_, deadline, self->cancel_};
+                auto r = ctx.expired() || ctx.cancelled()
+                             ? std::make_shared<const reply>(rejected(http::status::gateway_timeout))
+                             : invoke(*route, ctx);
+                boost::asio::post(self->socket_.get_executor(), [self, r = std::move(r)]() mutable
+                                  { self->do_write(std::move(r)); });
+            },
+            [self](http::status status)
+            {
+                boost::asio::post(self->socket_.get_executor(), [self, status]
+                                  { self->do_write(rejected(status)); });
+            },
+            priority,
+            ctx.deadline,
+            cancel_});
+        watch_peer();
+    }
+
+    // Reads concurrently with an off-thread handler so a client that hangs
+    // up (EOF or reset) cancels the request rather than the server finding
+    // out when the write fails. Bytes that do arrive are kept in buffer_.
+    // The read is tagged with the request's generation: once do_write has
+    // ended the request, a completion that was already queued neither
+    // re-arms nor cancels, and the next do_read() waits for it.
+    void watch_peer()
+    {
+        // buffer_ is capped at connection_memory_kb; prepare() past the cap
+        // throws. A full buffer goes unwatched until the next read.
+        auto room = std::min<std::size_t>(512, buffer_.max_size() - buffer_.size());
+        if (room == 0)
+            return;
+        auto self = shared_from_this();
+        watching_ = true;
+        socket_.async_read_some(buffer_.prepare(room),
+                                [self, generation = generation_](boost::beast::error_code ec, std::size_t n)
+                                {
+                                    self->watching_ = false;
+                                    if (!ec)
+                                        self->buffer_.commit(n);
+                                    if (self->read_after_watch_)
+                                    {
+                                        self->read_after_watch_ = false;
+                                        return self->do_read();
+                                    }
+                                    if (ec == boost::asio::error::operation_aborted ||
+                                        generation != self->generation_ || !self->cancel_)
+                                        return;
+                                    if (ec)
+                                        return self->cancel_->emit();
+                                    if (self->buffer_.size() < 64 * 1024)
+                                        self->watch_peer();
+                                });
+    }
+
+    void do_write(reply r)
+    {
+        do_write(std::make_shared<const reply>(std::move(r)));
+    }
+
+    void do_write(std::shared_ptr<const reply> r)
+    {
+        auto self = shared_from_this();
+
+        // The request is over for watch_peer; an outstanding read is
+        // aborted, or if it already completed, its handler sees the new
+        // generation.
+        generation_++;
+        if (watching_)
+        {
+            boost::beast::error_code ec;
+            socket_.cancel(ec);
+        }
+        if (cancel_ && cancel_->cancelled())
+        {
+            boost::beast::error_code ec;
+            socket_.close(ec);
+            return;
+        }
+
+        reply_ = std::move(r);
+        guard(transfer_watch::phase::writing);
+
+        std::size_t zerocopy_threshold;
+        std::array<coalesce_mode, body_kinds> coalesce;
+        {
+            rcu_domain::read_guard guard;
+            auto &settings = active_config().load()->settings;
+            keepalive_timeout_ = settings.keepalive_timeout;
+            keep_alive_ = keep_alive_ && keepalive_timeout_.count() > 0;
+            header_ = response_header(*reply_, req_.version(), keep_alive_, settings);
+            zerocopy_threshold = settings.zerocopy_threshold;
+            coalesce = settings.coalesce;
+        }
+        account();
+
+        body_kind kind = body_kind::memory;
+        if (reply_->file)
+            kind = body_kind::file;
+        else if (zerocopy_threshold && reply_->body.size() >= zerocopy_threshold && enable_zerocopy())
+            kind = body_kind::zerocopy;
+        auto mode = coalesce[static_cast<std::size_t>(kind)];
+
+        if (mode == coalesce_mode::writev)
+        {
+            std::array<boost::asio::const_buffer, 2> buffers = {
+                boost::asio::buffer(header_), boost::asio::buffer(reply_->body)};
+            boost::asio::async_write(socket_, buffers,
+                                     [self](boost::beast::error_code ec, std::size_t)
+                                     {
+                                         self->on_written(ec);
+                                     });
+            return;
+        }
+
+        // Corking holds back partial segments until uncorked in on_written,
+        // so the header rides in the same packet as the start of the body.
+        if (mode == coalesce_mode::cork)
+            set_cork(true);
+        write_header(0, mode == coalesce_mode::more, kind);
+    }
+
+    void set_cork(bool on)
+    {
+        int value = on ? 1 : 0;
+        if (::setsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_CORK, &value, sizeof value) == 0)
+            corked_ = on;
+    }
+
+    // MSG_MORE tells the kernel more data follows, so the header is not
+    // pushed out as a packet of its own.
+    void write_header(std::size_t offset, bool more, body_kind kind)
+    {
+        auto self = shared_from_this();
+        socket_.async_send(boost::asio::buffer(header_.data() + offset, header_.size() - offset),
+                           more ? MSG_MORE : 0,
+                           [self, offset, more, kind](boost::beast::error_code ec, std::size_t n)
+                           {
+                               if (ec)
+                                   return self->on_written(ec);
+                               if (offset + n < self->header_.size())
+                                   return self->write_header(offset + n, more, kind);
+                               self->write_body(kind);
+                           });
+    }
+
+    void write_body(body_kind kind)
+    {
+        auto self = shared_from_this();
+        switch (kind)
+        {
+        case body_kind::file:
+        {
+            boost::beast::error_code ec;
+            socket_.native_non_blocking(true, ec);
+            return send_file(0);
+        }
+        case body_kind::zerocopy:
+            return send_zerocopy(0);
+        case body_kind::memory:
+            boost::asio::async_write(socket_, boost::asio::buffer(reply_->body),
+                                     [self](boost::beast::error_code ec, std::size_t)
+                                     {
+                                         self->on_written(ec);
+                                     });
+        }
+    }
+
+    // Files go out one window at a time. A window that is not in the page
+    // cache is first read in on the file_io pool, because sendfile() would
+    // otherwise stall this I/O thread, and every connection on it, on the disk.
+    static constexpr off_t file_window = 1 << 20;
+
+    static bool resident(int fd, off_t begin, off_t end)
+    {
+        // RWF_NOWAIT reads fail with EAGAIN instead of going to the disk;
+        // probing the first and last byte catches the usual cold cases.
+        char probe;
+        iovec iov = {&probe, 1};
+        for (off_t at : {begin, end - 1})
+        {
+            if (::preadv2(fd, &iov, 1, at, RWF_NOWAIT) < 0)
+                return errno != EAGAIN; // EOPNOTSUPP: can't tell, just send
+        }
+        return true;
+    }
+
+    void send_file(off_t offset, bool prefetched = false)
+    {
+        auto self = shared_from_this();
+        auto &file = *reply_->file;
+        while (static_cast<std::uint64_t>(offset) < file.size)
+        {
+            off_t window_end = std::min<off_t>(offset + file_window, file.size);
+            if (!prefetched && !resident(file.fd, offset, window_end) && prefetch(offset, window_end))
+                return;
+            prefetched = false;
+
+            while (offset < window_end)
+            {
+                auto n = ::sendfile(socket_.native_handle(), file.fd, &offset, window_end - offset);
+                if (n > 0)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    socket_.async_wait(tcp::socket::wait_write, [self, offset](boost::beast::error_code ec)
+                                       {
+                        if (ec)
+                            return self->on_written(ec);
+                        self->send_file(offset); });
+                    return;
+                }
+                // n == 0: the file shrank under us; the client sees a short body.
+                return on_written(n == 0 ? boost::asio::error::eof
+                                         : boost::beast::error_code(errno, boost::system::system_category()));
+            }
+        }
+        on_written({});
+    }
+
+    // Reads [begin, end) on the file_io pool, then resumes sending on this
+    // session's strand. False if there is no pool to hand the read to.
+    bool prefetch(off_t begin, off_t end)
+    {
+        std::shared_ptr<exec_pool> pool;
+        {
+            rcu_domain::read_guard guard;
+            auto &pools = active_config().load()->pools;
+            auto it = pools.find(file_io_pool);
+            if (it == pools.end())
+                return false;
+            pool = it->second;
+        }
+
+        static auto &reads = metrics_registry::instance().counter(
+            "file_io_cold_reads_total", "File windows read on the file_io pool because they were not cached.");
+        static auto &bytes = metrics_registry::instance().counter(
+            "file_io_cold_bytes_total", "Bytes read on the file_io pool ahead of sendfile().");
+        reads++;
+        bytes += end - begin;
+
+        auto self = shared_from_this();
+        auto resume = [self, begin]
+        {
+            boost::asio::post(self->socket_.get_executor(), [self, begin]
+                              { self->send_file(begin, true); });
+        };
+        pool_job job;
+        job.run = [file = reply_->file, begin, end, resume]
+        {
+            // Start the disk on the window after this one while this one is
+            // read and sent.
+            ::posix_fadvise(file->fd, end, file_window, POSIX_FADV_WILLNEED);
+            thread_local std::unique_ptr<char[]> scratch(new char[file_window]);
+            for (off_t at = begin; at < end;)
+            {
+                auto n = ::pread(file->fd, scratch.get(), end - at, at);
+                if (n <= 0)
+                    break; // sendfile() reports it
+                at += n;
+            }
+            resume();
+        };
+        // Shed or dropped: send anyway and block on the disk, as before.
+        job.reject = [resume](http::status)
+        { resume(); };
+        job.cancel = cancel_;
+        pool->submit(std::move(job));
+        return true;
+    }
+
+    bool enable_zerocopy()
+    {
+        if (zerocopy_enabled_)
+            return true;
+        int one = 1;
+        boost::beast::error_code ec;
+        socket_.native_non_blocking(true, ec);
+        if (ec || ::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof one) != 0)
+            return false;
+        zerocopy_enabled_ = true;
+        return true;
+    }
+
+    // MSG_ZEROCOPY: the kernel sends straight from reply_->body instead of
+    // copying it into the socket buffer, and later reports on the socket's
+    // error queue when it no longer needs the pages. reply_ stays pinned
+    // until every send has been reported, and past a failed or dropped
+    // connection by linger_zerocopy.
+    void send_zerocopy(std::size_t offset)
+    {
+        static auto &sends = metrics_registry::instance().counter(
+            "zerocopy_sends_total", "send() calls issued with MSG_ZEROCOPY.");
+        static auto &bytes = metrics_registry::instance().counter(
+            "zerocopy_bytes_total", "Body bytes sent with MSG_ZEROCOPY.");
+
+        auto self = shared_from_this();
+        const std::string &body = reply_->body;
+        while (offset < body.size())
+        {
+            auto n = ::send(socket_.native_handle(), body.data() + offset, body.size() - offset,
+                            MSG_ZEROCOPY | MSG_NOSIGNAL);
+            if (n >= 0)
+            {
+                offset += static_cast<std::size_t>(n);
+                zerocopy_sent_++;
+                sends++;
+                bytes += n;
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                socket_.async_wait(tcp::socket::wait_write, [self, offset](boost::beast::error_code ec)
+                                   {
+                    if (ec)
+                        return self->on_written(ec);
+                    self->send_zerocopy(offset); });
+                return;
+            }
+            if (errno == ENOBUFS)
+            {
+                // Out of optmem for pinned pages: send the rest the usual way.
+                return boost::asio::async_write(socket_, boost::asio::buffer(body.data() + offset, body.size() - offset),
+                                                [self](boost::beast::error_code ec, std::size_t)
+                                                {
+                                                    self->reap_zerocopy(ec, std::chrono::microseconds(100));
+                                                });
+            }
+            return on_written(boost::beast::error_code(errno, boost::system::system_category()));
+        }
+        reap_zerocopy({}, std::chrono::microseconds(100));
+    }
+
+    // Drains completion notifications from the error queue. They arrive once
+    // the data is acknowledged (immediately on loopback, where the kernel
+    // copies anyway), so the queue is polled on a backing-off timer rather
+    // than trusting an edge-triggered EPOLLERR not to be missed.
+    void reap_zerocopy(boost::beast::error_code write_ec, std::chrono::microseconds backoff)
+    {
+        collect_zerocopy();
+        if (zerocopy_done_ >= zerocopy_sent_ || write_ec)
+            return on_written(write_ec);
+
+        auto self = shared_from_this();
+        paused_.expires_after(backoff);
+        paused_.async_wait([self, write_ec, backoff](boost::beast::error_code ec)
+                           {
+            if (ec)
+                return self->on_written(ec);
+            self->reap_zerocopy(write_ec, std::min(backoff * 2, std::chrono::microseconds(10000))); });
+    }
+
+    // The connection failed or is being dropped with zerocopy sends still
+    // unreported, so the kernel may yet read the body's pages. Resetting it
+    // (connect to AF_UNSPEC) frees the queued data without closing the fd,
+    // and `pinned` keeps the body until the error queue says the pages are
+    // released, or a second has passed since the reset.
+    void linger_zerocopy(std::shared_ptr<const reply> pinned, std::chrono::steady_clock::time_point give_up)
+    {
+        collect_zerocopy();
+        boost::beast::error_code ec;
+        if (zerocopy_done_ >= zerocopy_sent_ || std::chrono::steady_clock::now() > give_up)
+        {
+            socket_.close(ec);
+            return;
+        }
+        auto self = shared_from_this();
+        paused_.expires_after(std::chrono::milliseconds(1));
+        paused_.async_wait([self, pinned = std::move(pinned), give_up](boost::beast::error_code)
+                           { self->linger_zerocopy(pinned, give_up); });
+    }
+
+    void collect_zerocopy()
+    {
+        static auto &copied = metrics_registry::instance().counter(
+            "zerocopy_copied_total", "MSG_ZEROCOPY sends the kernel completed by copying.");
+
+        int fd = socket_.native_handle();
+        for (;;)
+        {
+            char control[128];
+            msghdr msg = {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof control;
+            if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+                break;
+            for (auto *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+            {
+                if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                      (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                    continue;
+                auto *err = reinterpret_cast<const sock_extended_err *>(CMSG_DATA(cm));
+                if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                    continue;
+                zerocopy_done_ += err->ee_data - err->ee_info + 1;
+                if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                    copied++;
+            }
+        }
+    }
+
+    void on_written(boost::beast::error_code ec)
+    {
+        if (corked_)
+            set_cork(false);
+        if (in_flight_)
+        {
+            requests_in_flight--;
+            in_flight_ = false;
+        }
+        if (latency_)
+        {
+            latency_->observe((tsc_clock::now() - started_).count());
+            latency_ = nullptr;
+            responses_completed++;
+        }
+        if (ec && zerocopy_done_ < zerocopy_sent_ && socket_.is_open())
+        {
+            sockaddr reset = {};
+            reset.sa_family = AF_UNSPEC;
+            ::connect(socket_.native_handle(), &reset, sizeof reset);
+            linger_zerocopy(std::move(reply_), std::chrono::steady_clock::now() + std::chrono::seconds(1));
+        }
+        reply_.reset();
+        header_.clear();
+        req_ = {};
+        cancel_.reset();
+        watch_.start(transfer_watch::phase::none, -1);
+        account();
+        if (!ec && keep_alive_)
+        {
+            // Wait for the next request, which may already be in buffer_.
+            auto self = shared_from_this();
+            idle_.expires_after(keepalive_timeout_);
+            idle_.async_wait([self](boost::beast::error_code ec)
+                             {
+                if (!ec)
+                    self->socket_.close(ec); });
+            // Never two reads on the socket: a watch read still on its way
+            // back may hold the start of the next request.
+            if (watching_)
+            {
+                read_after_watch_ = true;
+                return;
+            }
+            return do_read();
+        }
+        guard_.cancel();
+        socket_.shutdown(tcp::socket::shutdown_send, ec);
+    }
+};
+
+// ---------------------------
+// I/O THREADS
+// ---------------------------
+// Exports the CPU time of the calling I/O thread as
+// io_thread_cpu_seconds_total{thread="N"}, so what busy polling burns shows
+// up next to the latency it buys.
+void enroll_io_thread(int index)
+{
+    sampling_profiler::instance().enroll(index);
+    clockid_t clock;
+    if (::pthread_getcpuclockid(::pthread_self(), &clock) != 0)
+        return;
+    auto &metrics = metrics_registry::instance();
+    auto &cpu = metrics.counter("io_thread_cpu_seconds_total", "CPU time used by each I/O thread.",
+                                "thread=\"" + std::to_string(index) + "\"", 1e-9);
+    metrics.on_collect([clock, &cpu]
+                       {
+        timespec ts;
+        if (::clock_gettime(clock, &ts) == 0)
+            cpu = ts.tv_sec * 1000000000LL + ts.tv_nsec; });
+}
+
+// Tracks one busy-polling thread's spin-then-park decisions: spin while work
+// keeps turning up within `spin` of the last, otherwise park.
+class spin_budget
+{
+    const tsc_clock::duration spin_;
+    tsc_clock::time_point idle_since_{};
+    bool idle_ = false;
+
+public:
+    explicit spin_budget(std::chrono::microseconds spin) : spin_(spin) {}
+
+    // Call after every poll; true once the thread should sleep instead.
+    bool poll_done(bool found_work)
+    {
+        static auto &spinning = metrics_registry::instance().counter(
+            "io_thread_spin_seconds_total", "Time busy-polling I/O threads spent spinning with nothing to do.",
+            "", 1e-6);
+        static auto &parks = metrics_registry::instance().counter(
+            "io_thread_parks_total", "Times a busy-polling I/O thread used up its spin budget and slept.");
+
+        auto now = tsc_clock::now();
+        if (!idle_ && !found_work)
+        {
+            idle_ = true;
+            idle_since_ = now;
+            return false;
+        }
+        if (!idle_)
+            return false;
+        if (found_work || now - idle_since_ >= spin_)
+        {
+            spinning += std::chrono::duration_cast<std::chrono::microseconds>(now - idle_since_).count();
+            idle_ = false;
+            if (!found_work)
+            {
+                parks++;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Runs `ioc` on the calling thread. With a spin budget the thread polls for
+// ready handlers instead of sleeping in epoll and only parks (run_one) after
+// `spin` has passed without any.
+void run_io_thread(boost::asio::io_context &ioc, std::chrono::microseconds spin)
+{
+    if (spin.count() == 0)
+    {
+        ioc.run();
+        return;
+    }
+    spin_budget budget(spin);
+    while (!ioc.stopped())
+    {
+        if (budget.poll_done(ioc.poll() > 0))
+            ioc.run_one();
+    }
+}
+
+// SO_BUSY_POLL on an accepted socket: blocking reads and epoll spin on the
+// device queue for up to `us` microseconds. Raising it above
+// net.core.busy_read needs CAP_NET_ADMIN; failure leaves the socket as is.
+void set_busy_poll(int fd, int us)
+{
+    if (us > 0)
+        ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof us);
+}
+
+// ---------------------------
+// IO_URING
+// ---------------------------
+// Minimal io_uring ring over the raw syscalls (no liburing dependency). Only
+// what the reactor needs: queue SQEs, submit them in batches, drain CQEs, and
+// keep sparse tables of registered buffers and files up to date.
+class uring
+{
+    int fd_ = -1;
+    void *sq_ring_ = MAP_FAILED;
+    void *cq_ring_ = MAP_FAILED;
+    std::size_t sq_ring_size_ = 0;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe *sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+    std::size_t sqes_size_ = 0;
+
+    unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    io_uring_cqe *cqes_;
+    unsigned sq_entries_ = 0;
+    unsigned queued_ = 0; // SQEs not yet handed to the kernel
+
+    static std::runtime_error failure(const char *what)
+    {
+        return std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+    }
+
+    template <class T>
+    static T *at(void *base, unsigned offset)
+    {
+        return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+    }
+
+public:
+    explicit uring(unsigned entries)
+    {
+        io_uring_params p = {};
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        if (fd_ < 0)
+            throw failure("io_uring_setup");
+
+        sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+        sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED)
+            throw failure("io_uring mmap");
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            cq_ring_ = sq_ring_;
+        else
+        {
+            cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED)
+                throw failure("io_uring mmap");
+        }
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe *>(::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED)
+            throw failure("io_uring mmap");
+
+        sq_head_ = at<unsigned>(sq_ring_, p.sq_off.head);
+        sq_tail_ = at<unsigned>(sq_ring_, p.sq_off.tail);
+        sq_mask_ = at<unsigned>(sq_ring_, p.sq_off.ring_mask);
+        sq_array_ = at<unsigned>(sq_ring_, p.sq_off.array);
+        cq_head_ = at<unsigned>(cq_ring_, p.cq_off.head);
+        cq_tail_ = at<unsigned>(cq_ring_, p.cq_off.tail);
+        cq_mask_ = at<unsigned>(cq_ring_, p.cq_off.ring_mask);
+        cqes_ = at<io_uring_cqe>(cq_ring_, p.cq_off.cqes);
+        sq_entries_ = p.sq_entries;
+    }
+
+    ~uring()
+    {
+        if (sqes_ != MAP_FAILED)
+            ::munmap(sqes_, sqes_size_);
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+            ::munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_ != MAP_FAILED)
+            ::munmap(sq_ring_, sq_ring_size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    uring(const uring &) = delete;
+    uring &operator=(const uring &) = delete;
+
+    // Readable (for epoll) while completions are waiting.
+    int fd() const { return fd_; }
+
+    // A zeroed SQE queued for the next submit(); flushes the queue first if it
+    // is full. Without SQPOLL the kernel only reads SQEs inside
+    // io_uring_enter, so filling the entry after the tail moved is fine.
+    io_uring_sqe *sqe()
+    {
+        unsigned tail = *sq_tail_;
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+        {
+            submit();
+            tail = *sq_tail_;
+        }
+        unsigned index = tail & *sq_mask_;
+        auto *e = &sqes_[index];
+        std::memset(e, 0, sizeof *e);
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        queued_++;
+        return e;
+    }
+
+    // Hands every queued SQE to the kernel in one syscall, optionally waiting
+    // for `wait` completions.
+    void submit(unsigned wait = 0)
+    {
+        if (!queued_ && !wait)
+            return;
+        for (;;)
+        {
+            auto n = ::syscall(__NR_io_uring_enter, fd_, queued_, wait,
+                               wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (n >= 0)
+            {
+                queued_ -= static_cast<unsigned>(n);
+                return;
+            }
+            if (errno != EINTR)
+                throw failure("io_uring_enter");
+        }
+    }
+
+    // Calls f(user_data, res) for every completion waiting in the ring.
+    template <class F>
+    void reap(F &&f)
+    {
+        unsigned head = *cq_head_;
+        while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+        {
+            auto &cqe = cqes_[head & *cq_mask_];
+            auto user_data = cqe.user_data;
+            auto res = cqe.res;
+            __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+            f(user_data, res);
+        }
+    }
+
+    // Sparse tables: `buffers` registered buffers and `files` fixed files,
+    // filled one slot at a time with set_buffer() / set_file().
+    void register_tables(unsigned buffers, unsigned files)
+    {
+        io_uring_rsrc_register r = {};
+        r.flags = IORING_RSRC_REGISTER_SPARSE;
+        r.nr = buffers;
+        if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS2, &r, sizeof r) < 0)
+            throw failure("io_uring register buffers");
+        r.nr = files;
+        if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_FILES2, &r, sizeof r) < 0)
+            throw failure("io_uring register files");
+    }
+
+    // Pins `size` bytes at `data` as buffer `slot`; nullptr/0 unpins it.
+    // Operations already in flight keep the previous buffer until they finish.
+    bool set_buffer(unsigned slot, const void *data, std::size_t size)
+    {
+        iovec iov = {const_cast<void *>(data), size};
+        io_uring_rsrc_update2 u = {};
+        u.offset = slot;
+        u.data = reinterpret_cast<std::uintptr_t>(&iov);
+        u.nr = 1;
+        return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS_UPDATE, &u, sizeof u) == 1;
+    }
+
+    // Installs `fd` as fixed file `slot` (the ring takes its own reference);
+    // -1 clears it.
+    bool set_file(unsigned slot, int fd)
+    {
+        io_uring_rsrc_update2 u = {};
+        u.offset = slot;
+        u.data = reinterpret_cast<std::uintptr_t>(&fd);
+        u.nr = 1;
+        return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_FILES_UPDATE2, &u, sizeof u) == 1;
+    }
+};
+
+// ---------------------------
+// EPOLL REACTOR
 // ---------------------------
-std::string handle_request(const http::request<http::string_body> &req)
+// Alternative to the asio backend for tiny, fast handlers (`backend epoll`).
+// Every I/O thread owns an edge-triggered epoll set and its own SO_REUSEPORT
+// listener, takes readiness in batches, and runs read -> parse -> route ->
+// handler -> write inline for each ready connection with no completion
+// handlers, strands or shared_ptr hops in between. Routing, handlers and the
+// response cache are the same as the asio backend so the two compare like for
+// like; bulkheads, deadlines, disconnect cancellation and zero-copy sends are
+// asio backend features and are not applied here.
+//
+// `backend uring` is the same reactor with an io_uring ring next to the epoll
+// set. Cache hits are sent through the ring: their bodies are registered
+// buffers (WRITE_FIXED, no per-send page pinning) and their files fixed files
+// (READ_FIXED into a registered staging buffer, no fd table lookup). Misses
+// keep the plain send/sendfile path.
+class epoll_reactor
 {
-    std::string target = std::string(req.target());
+    struct connection
+    {
+        int fd;
+        std::string in;
+        boost::optional<http::request_parser<http::string_body>> parser;
+        std::shared_ptr<const reply> out; // keeps the body (or file) alive
+        std::string header;
+        std::size_t sent = 0; // bytes of header + in-memory body written
+        off_t file_offset = 0;
+        bool responding = false;
+        tsc_clock::time_point started; // when the request was complete
+        metric_histogram *latency = nullptr;
+        bool in_flight = false; // counted in requests_in_flight
+        bool keep_alive = false;
+        std::size_t body_limit = 0;
+        deadline_clock::time_point active; // last bytes read or response finished
+        transfer_watch watch;
 
-    if (target == "/hello")
-        return "hello\n";
+        // Ring path: one operation in flight at a time, epoll events ignored.
+        bool in_ring = false;
+        bool reading = false;
+        int buffer_slot = -1;
+        int file_slot = -1;
+        int staging = -1;
+        std::size_t staged = 0; // file bytes in the staging buffer / written
+        std::size_t staged_sent = 0;
+    };
 
-    if (target == "/headers")
+    // A sparse registration table; slots remember their owner so a reply
+    // served again reuses its slot and a departed one can be unpinned.
+    struct fixed_slot
     {
-        std::string headers;
-        for (auto &h : req.base())
+        std::weak_ptr<const void> owner;
+        bool live = false;
+        unsigned users = 0; // ring responses sending from the slot right now
+    };
+
+    static constexpr int max_events = 256;
+    static constexpr unsigned buffer_slots = 64;
+    static constexpr unsigned staging_slots = 16;
+    static constexpr std::size_t staging_size = 256 * 1024;
+    static constexpr unsigned file_slots = 64;
+
+    int epoll_fd_ = -1;
+    int listen_fd_ = -1;
+
+    std::unique_ptr<uring> ring_;
+    std::vector<fixed_slot> buffers_;
+    std::vector<fixed_slot> files_;
+    unsigned next_buffer_ = 0; // round-robin victims when every slot is live and idle
+    unsigned next_file_ = 0;
+    std::vector<std::unique_ptr<char[]>> staging_;
+    std::vector<int> free_staging_;
+
+    // Every open connection, for the once-a-second idle sweep that enforces
+    // keepalive_timeout_ms.
+    std::unordered_set<connection *> connections_;
+    deadline_clock::time_point next_sweep_{};
+
+    // When the batch of events being handled started; 0 while waiting in
+    // epoll. Read by the load monitor from another thread.
+    std::atomic<std::int64_t> busy_since_{0};
+
+public:
+    epoll_reactor(unsigned short port, bool use_uring)
+    {
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (epoll_fd_ < 0 || listen_fd_ < 0)
+            throw std::runtime_error(std::string("epoll reactor: ") + std::strerror(errno));
+
+        int one = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0 ||
+            ::listen(listen_fd_, SOMAXCONN) != 0)
+            throw std::runtime_error(std::string("epoll reactor: ") + std::strerror(errno));
+
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = nullptr; // the listener
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+
+        if (use_uring)
         {
-            headers += std::string(h.name_string()) + ": " + std::string(h.value()) + "\n";
+            ring_ = std::make_unique<uring>(max_events);
+            ring_->register_tables(buffer_slots + staging_slots, file_slots);
+            buffers_.resize(buffer_slots);
+            files_.resize(file_slots);
+            for (unsigned i = 0; i < staging_slots; i++)
+            {
+                staging_.emplace_back(new char[staging_size]);
+                if (!ring_->set_buffer(buffer_slots + i, staging_.back().get(), staging_size))
+                    throw std::runtime_error(std::string("io_uring staging buffer: ") + std::strerror(errno));
+                free_staging_.push_back(static_cast<int>(i));
+            }
+
+            // Level triggered: readable for as long as completions wait.
+            epoll_event ring_ev = {};
+            ring_ev.events = EPOLLIN;
+            ring_ev.data.ptr = this;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, ring_->fd(), &ring_ev);
         }
-        return headers;
     }
-    return "Not Found";
-}
 
-// ---------------------------
-// PER-SESSION CLASS
-// ---------------------------
-class session : public std::enable_shared_from_this<session>
-{
-    tcp::socket socket_;
-    boost::beast::flat_buffer buffer_;
-    http::request<http::string_body> req_;
-    http::response<http::string_body> res_;
+    ~epoll_reactor()
+    {
+        ::close(listen_fd_);
+        ::close(epoll_fd_);
+    }
 
-public:
-    explicit session(tcp::socket socket)
-        : socket_(std::move(socket)) {}
+    epoll_reactor(const epoll_reactor &) = delete;
+    epoll_reactor &operator=(const epoll_reactor &) = delete;
 
-    void run()
+    // How long the loop has been busy with its current batch, i.e. the
+    // longest a newly ready connection has been waiting for it.
+    tsc_clock::duration lag() const
     {
-        do_read();
+        auto since = busy_since_.load(std::memory_order_relaxed);
+        if (since == 0)
+            return tsc_clock::duration::zero();
+        return std::max(tsc_clock::now().time_since_epoch() - tsc_clock::duration(since),
+                        tsc_clock::duration::zero());
+    }
+
+    // With a spin budget, epoll_wait does not sleep until `spin` has passed
+    // without events.
+    void run(std::chrono::microseconds spin)
+    {
+        epoll_event events[max_events];
+        spin_budget budget(spin);
+        bool park = !spin.count();
+        for (;;)
+        {
+            int sleep_ms = connections_.empty() ? -1 : 1000;
+            int n = ::epoll_wait(epoll_fd_, events, max_events, park ? sleep_ms : 0);
+            if (spin.count())
+                park = budget.poll_done(n > 0);
+            if (n < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+            if (n > 0)
+                busy_since_.store(tsc_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            for (int i = 0; i < n; i++)
+            {
+                if (!events[i].data.ptr)
+                    accept_all();
+                else if (events[i].data.ptr == this)
+                    ring_->reap([this](std::uint64_t user_data, int res)
+                                { on_complete(reinterpret_cast<connection *>(user_data), res); });
+                else
+                    on_ready(static_cast<connection *>(events[i].data.ptr), events[i].events);
+            }
+            // Everything the batch queued goes to the kernel in one syscall.
+            if (ring_)
+                ring_->submit();
+            if (!connections_.empty() && deadline_clock::now() >= next_sweep_)
+                sweep();
+            busy_since_.store(0, std::memory_order_relaxed);
+        }
     }
 
 private:
-    void do_read()
+    void accept_all()
     {
-        auto self = shared_from_this();
+        std::size_t connection_budget;
+        int busy_poll, send_queue;
+        {
+            rcu_domain::read_guard guard;
+            auto &settings = active_config().load()->settings;
+            connection_budget = settings.connection_memory;
+            busy_poll = settings.busy_poll_socket;
+            send_queue = settings.send_queue;
+        }
 
-        http::async_read(socket_, buffer_, req_,
-                         [self](boost::beast::error_code ec, std::size_t)
-                         {
-                             if (!ec)
-                                 self->do_write();
-                         });
+        for (;;)
+        {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    std::cerr << "accept error: " << std::strerror(errno) << "\n";
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+
+            set_busy_poll(fd, busy_poll);
+            set_send_queue(fd, send_queue);
+            auto *c = new connection{fd};
+            c->body_limit = connection_budget;
+            reset(c);
+            connections_.insert(c);
+
+            // Registered once for both directions; edge triggering means each
+            // readiness change is reported exactly once.
+            epoll_event ev = {};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = c;
+            if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0)
+            {
+                close(c);
+                continue;
+            }
+            // Data often arrives with the handshake; don't wait for an edge.
+            on_ready(c, EPOLLIN);
+        }
     }
 
-    void do_write()
+    // Ready for the next request on the connection.
+    void reset(connection *c)
     {
-        auto self = shared_from_this();
+        bool idle = c->keep_alive && c->in.empty();
+        leave_flight(c);
+        if (c->staging >= 0)
+            free_staging_.push_back(c->staging);
+        c->parser.emplace();
+        c->parser->eager(true);
+        c->parser->body_limit(c->body_limit);
+        c->out.reset();
+        c->header.clear();
+        c->sent = 0;
+        c->file_offset = 0;
+        c->responding = false;
+        c->latency = nullptr;
+        c->keep_alive = false;
+        c->in_ring = false;
+        c->reading = false;
+        release_slots(c);
+        c->staging = -1;
+        c->staged = c->staged_sent = 0;
+        c->active = deadline_clock::now();
+        c->watch.start(transfer_watch::phase::reading, c->fd, idle);
+    }
+
+    void close(connection *c)
+    {
+        leave_flight(c);
+        release_slots(c);
+        if (c->staging >= 0)
+            free_staging_.push_back(c->staging);
+        connections_.erase(c);
+        ::close(c->fd); // also removes it from the epoll set
+        delete c;
+    }
+
+    static void leave_flight(connection *c)
+    {
+        if (c->in_flight)
+            requests_in_flight--;
+        c->in_flight = false;
+    }
+
+    void on_ready(connection *c, std::uint32_t events)
+    {
+        if (c->in_ring)
+            return; // the pending ring operation reports any error
+        if (events & EPOLLERR)
+            return close(c);
+        if (c->responding)
+        {
+            if (events & (EPOLLOUT | EPOLLHUP))
+                flush(c);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+            read(c);
+    }
+
+    // Edge triggered: drain the socket until EAGAIN or the request is done.
+    // Bytes left over from the previous request (pipelining) are parsed
+    // before reading more.
+    void read(connection *c)
+    {
+        char chunk[16 * 1024];
+        for (;;)
+        {
+            if (!c->in.empty())
+            {
+                boost::beast::error_code ec;
+                auto used = c->parser->put(boost::asio::buffer(c->in), ec);
+                c->in.erase(0, used);
+                if (ec == http::error::body_limit)
+                    return respond(c, std::make_shared<const reply>(
+                                          reply{http::status::payload_too_large, "", "Payload Too Large\n", {}, nullptr}),
+                                   false);
+                if ((ec && ec != http::error::need_more) || c->in.size() > 64 * 1024)
+                    return close(c);
+                if (c->parser->is_done())
+                {
+                    c->started = tsc_clock::now();
+                    requests_in_flight++;
+                    c->in_flight = true;
+                    traffic_capture::instance().record(c->parser->get(), c->started);
+                    bool hit = false;
+                    auto r = handle(c->parser->get(), hit, c->latency);
+                    return respond(c, std::move(r), hit);
+                }
+            }
+
+            auto n = ::recv(c->fd, chunk, sizeof chunk, 0);
+            if (n > 0)
+            {
+                c->in.append(chunk, static_cast<std::size_t>(n));
+                c->active = deadline_clock::now();
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            return close(c); // EOF before a full request, or a reset
+        }
+    }
 
-        std::string body = handle_request(req_);
+    // Closes connections that have been idle, between or inside requests,
+    // for longer than keepalive_timeout_ms, and those transfer_watch finds
+    // too slow.
+    void sweep()
+    {
+        auto now = deadline_clock::now();
+        next_sweep_ = now + std::chrono::seconds(1);
+        std::vector<connection *> idle;
+        std::vector<std::pair<connection *, const char *>> slow;
+        {
+            rcu_domain::read_guard guard;
+            auto &settings = active_config().load()->settings;
+            auto timeout = settings.keepalive_timeout;
+            if (timeout.count() == 0)
+                timeout = std::chrono::milliseconds(5000); // one-shot connections still time out
+            for (auto *c : connections_)
+            {
+                // A ring operation still refers to the connection; its
+                // completion finishes or closes it.
+                if (!c->responding && !c->in_ring && now - c->active > timeout)
+                    idle.push_back(c);
+                else if (auto reason = c->watch.check(c->fd, c->parser->is_header_done(), settings))
+                    slow.emplace_back(c, reason);
+            }
+        }
+        for (auto *c : idle)
+            close(c);
+        for (auto &s : slow)
+        {
+            count_slow_close(s.second);
+            s.first->watch.start(transfer_watch::phase::none, -1);
+            // A ring operation still refers to the connection: fail it and
+            // let its completion do the closing.
+            if (s.first->in_ring)
+                ::shutdown(s.first->fd, SHUT_RDWR);
+            else
+                close(s.first);
+        }
+    }
 
-        res_.version(req_.version());
-        res_.keep_alive(false);
+    static std::shared_ptr<const reply> handle(const http::request<http::string_body> &req, bool &hit,
+                                               metric_histogram *&latency)
+    {
+        auto route = find_route(req.target());
+        if (!route)
+        {
+            static auto &unmatched = request_latency("");
+            latency = &unmatched;
+            return std::make_shared<const reply>(not_found());
+        }
+        latency = route->latency;
+        if (route->cache_ttl.count() && req.method() == http::verb::get)
+        {
+            if (auto cached = response_cache::instance().find(std::string(req.target())))
+            {
+                hit = true;
+                return cached;
+            }
+        }
+        request_context ctx{req};
+        return invoke(*route, ctx);
+    }
 
-        if (body == "Not Found")
+    void respond(connection *c, std::shared_ptr<const reply> r, bool hit)
+    {
+        c->watch.start(transfer_watch::phase::writing, c->fd);
+        bool keep_alive = c->parser->is_done() && c->parser->get().keep_alive();
         {
-            res_.result(http::status::not_found);
+            rcu_domain::read_guard guard;
+            auto &settings = active_config().load()->settings;
+            keep_alive = keep_alive && settings.keepalive_timeout.count() > 0;
+            c->header = response_header(*r, c->parser->get().version(), keep_alive, settings);
         }
+        c->out = std::move(r);
+        c->responding = true;
+        c->keep_alive = keep_alive;
+        // Only cache hits are worth registering: they are the replies that
+        // will be sent again.
+        if (ring_ && hit && start_fixed(c))
+            ring_step(c);
         else
+            flush(c);
+    }
+
+    // Finds or claims the registered slot for `owner` and counts the caller
+    // as one of its users until release_slots(); `update(slot, owner)`
+    // installs a new owner or, with nullptr, unpins a departed one. A slot
+    // another response is still sending from is never taken over, so with
+    // every slot busy this returns -1 and the response goes out unregistered.
+    template <class Update>
+    static int claim_slot(std::vector<fixed_slot> &table, unsigned &next,
+                          const std::shared_ptr<const void> &owner, Update update)
+    {
+        int spare = -1;
+        for (std::size_t i = 0; i < table.size(); i++)
+        {
+            auto &slot = table[i];
+            if (slot.live && !slot.owner.owner_before(owner) && !owner.owner_before(slot.owner))
+            {
+                slot.users++;
+                return static_cast<int>(i);
+            }
+            if (slot.live && !slot.users && slot.owner.expired())
+            {
+                update(i, nullptr);
+                slot = {};
+            }
+            if (!slot.live && spare < 0)
+                spare = static_cast<int>(i);
+        }
+        for (std::size_t tries = 0; spare < 0 && tries < table.size(); tries++)
         {
-            res_.result(http::status::ok);
+            auto victim = next++ % table.size();
+            if (!table[victim].users)
+                spare = static_cast<int>(victim);
         }
+        if (spare < 0)
+            return -1;
 
-        res_.set(http::field::server, "Boost.Beast Server");
-        res_.body() = body;
-        res_.prepare_payload();
+        table[spare] = {};
+        if (!update(spare, owner))
+            return -1;
+        table[spare] = {owner, true, 1};
+        static auto &registrations = metrics_registry::instance().counter(
+            "uring_registrations_total", "Buffers and files registered with an io_uring ring.");
+        registrations++;
+        return spare;
+    }
 
-        http::async_write(socket_, res_,
-                          [self](boost::beast::error_code ec, std::size_t)
-                          {
-                              self->socket_.shutdown(tcp::socket::shutdown_send, ec);
-                          });
+    bool start_fixed(connection *c)
+    {
+        auto &r = c->out;
+        if (!r->body.empty())
+        {
+            c->buffer_slot = claim_slot(buffers_, next_buffer_, r, [&](std::size_t slot, const std::shared_ptr<const void> &owner)
+                                        { return owner ? ring_->set_buffer(slot, r->body.data(), r->body.size())
+                                                       : ring_->set_buffer(slot, nullptr, 0); });
+        }
+        if (r->file && r->file->size)
+        {
+            if (free_staging_.empty())
+                return false;
+            c->file_slot = claim_slot(files_, next_file_, r->file, [&](std::size_t slot, const std::shared_ptr<const void> &owner)
+                                      { return ring_->set_file(slot, owner ? r->file->fd : -1); });
+            if (c->file_slot < 0)
+                return false;
+            c->staging = free_staging_.back();
+            free_staging_.pop_back();
+        }
+        c->in_ring = true;
+        return true;
+    }
+
+    void release_slots(connection *c)
+    {
+        if (c->buffer_slot >= 0)
+            buffers_[c->buffer_slot].users--;
+        if (c->file_slot >= 0)
+            files_[c->file_slot].users--;
+        c->buffer_slot = c->file_slot = -1;
+    }
+
+    // Queues the next operation of a ring response; its completion comes
+    // back through on_complete().
+    void ring_step(connection *c)
+    {
+        static auto &fixed_bytes = metrics_registry::instance().counter(
+            "uring_fixed_bytes_total", "Bytes sent from io_uring registered buffers and fixed files.");
+        auto &body = c->out->body;
+        auto *sqe = ring_->sqe();
+        sqe->fd = c->fd;
+        sqe->user_data = reinterpret_cast<std::uintptr_t>(c);
+
+        if (c->sent < c->header.size())
+        {
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->addr = reinterpret_cast<std::uintptr_t>(c->header.data() + c->sent);
+            sqe->len = static_cast<std::uint32_t>(c->header.size() - c->sent);
+        }
+        else if (c->sent < c->header.size() + body.size())
+        {
+            auto offset = c->sent - c->header.size();
+            sqe->opcode = c->buffer_slot >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe->buf_index = static_cast<std::uint16_t>(std::max(c->buffer_slot, 0));
+            sqe->addr = reinterpret_cast<std::uintptr_t>(body.data() + offset);
+            sqe->len = static_cast<std::uint32_t>(std::min<std::size_t>(body.size() - offset, 1u << 30));
+            if (c->buffer_slot >= 0)
+                fixed_bytes += sqe->len;
+        }
+        else if (c->staged_sent < c->staged)
+        {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->buf_index = static_cast<std::uint16_t>(buffer_slots + c->staging);
+            sqe->addr = reinterpret_cast<std::uintptr_t>(staging_[c->staging].get() + c->staged_sent);
+            sqe->len = static_cast<std::uint32_t>(c->staged - c->staged_sent);
+        }
+        else if (c->staging >= 0 && static_cast<std::uint64_t>(c->file_offset) < c->out->file->size)
+        {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->fd = c->file_slot;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->buf_index = static_cast<std::uint16_t>(buffer_slots + c->staging);
+            sqe->addr = reinterpret_cast<std::uintptr_t>(staging_[c->staging].get());
+            sqe->len = static_cast<std::uint32_t>(std::min<std::uint64_t>(c->out->file->size - c->file_offset, staging_size));
+            sqe->off = static_cast<std::uint64_t>(c->file_offset);
+            c->reading = true;
+            fixed_bytes += sqe->len;
+        }
+        else
+        {
+            // Done: turn the SQE into a no-op whose completion closes.
+            sqe->opcode = IORING_OP_NOP;
+            c->responding = false;
+            c->active = deadline_clock::now();
+        }
+    }
+
+    void on_complete(connection *c, int res)
+    {
+        if (!c->responding)
+            return finish(c);
+        if (res == -EINTR || res == -EAGAIN)
+            return ring_step(c);
+        if (res <= 0)
+            return close(c); // write error, or the file shrank under us
+
+        auto n = static_cast<std::size_t>(res);
+        if (c->reading)
+        {
+            c->reading = false;
+            c->staged = n;
+            c->staged_sent = 0;
+            c->file_offset += res;
+        }
+        else if (c->sent < c->header.size() + c->out->body.size())
+            c->sent += n;
+        else
+            c->staged_sent += n;
+        ring_step(c);
+    }
+
+    void flush(connection *c)
+    {
+        auto &body = c->out->body;
+        while (c->sent < c->header.size() + body.size())
+        {
+            iovec iov[2];
+            int count = 0;
+            if (c->sent < c->header.size())
+                iov[count++] = {const_cast<char *>(c->header.data()) + c->sent, c->header.size() - c->sent};
+            auto body_off = c->sent > c->header.size() ? c->sent - c->header.size() : 0;
+            if (body_off < body.size())
+                iov[count++] = {const_cast<char *>(body.data()) + body_off, body.size() - body_off};
+
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            auto n = ::sendmsg(c->fd, &msg, MSG_NOSIGNAL | (c->out->file ? MSG_MORE : 0));
+            if (n >= 0)
+            {
+                c->sent += static_cast<std::size_t>(n);
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return close(c);
+            return; // EPOLLOUT edge resumes
+        }
+
+        if (auto &file = c->out->file)
+        {
+            while (static_cast<std::uint64_t>(c->file_offset) < file->size)
+            {
+                auto n = ::sendfile(c->fd, file->fd, &c->file_offset, file->size - c->file_offset);
+                if (n > 0)
+                    continue;
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return;
+                return close(c);
+            }
+        }
+
+        finish(c);
+    }
+
+    // The whole response is with the kernel.
+    void finish(connection *c)
+    {
+        if (c->latency)
+        {
+            c->latency->observe((tsc_clock::now() - c->started).count());
+            responses_completed++;
+        }
+        if (c->keep_alive)
+        {
+            reset(c);
+            return read(c); // edges that came in while responding were ignored
+        }
+        ::shutdown(c->fd, SHUT_WR);
+        close(c);
     }
 };
 
@@ -142,12 +5587,20 @@ private:
         // lambda or callback may outlive the original scope that created it.
         auto self = shared_from_this();
 
-        self->socket_ = tcp::socket(ioc_);
+        self->socket_ = tcp::socket(boost::asio::make_strand(ioc_));
 
         acceptor_.async_accept(self->socket_, [self](boost::beast::error_code ec)
                                {
             if(!ec){
-                std::make_shared<session>(std::move(self->socket_))->run();
+                std::size_t connection_budget;
+                {
+                    rcu_domain::read_guard guard;
+                    auto &settings = active_config().load()->settings;
+                    connection_budget = settings.connection_memory;
+                    set_busy_poll(self->socket_.native_handle(), settings.busy_poll_socket);
+                    set_send_queue(self->socket_.native_handle(), settings.send_queue);
+                }
+                std::make_shared<session>(std::move(self->socket_), connection_budget)->run();
             }else {
                 std::cerr << "accept error: " << ec.message() << "\n";
             }
@@ -155,13 +5608,329 @@ private:
     }
 };
 
-int main()
+// ---------------------------
+// LOAD REPORTING
+// ---------------------------
+// Folds in-flight requests, event loop lag, CPU utilization and the jobs
+// queued in pools and bulkheads into one smoothed score for client-side
+// balancers. Each signal is scaled by the load_score mark that counts as
+// fully loaded (CPU by the cores the process may use) and the score is the
+// highest of them, so 1 means something is saturated. Every tick the report
+// is serialised once and published for the load header and `load` handler.
+class load_monitor
+{
+    boost::asio::steady_timer timer_;
+    boost::asio::io_context *io_ = nullptr; // asio backend, probed for lag
+    std::vector<const epoll_reactor *> reactors_;
+    std::atomic<std::int64_t> probe_sent_{0}; // 0 = no probe outstanding
+    std::atomic<std::int64_t> probe_lag_{0};
+
+    int cores_ = 1;
+    bool primed_ = false;
+    tsc_clock::time_point last_tick_;
+    std::int64_t last_cpu_ = 0;
+    std::int64_t last_spin_ = 0;
+    std::uint64_t last_responses_ = 0;
+
+    // Smoothed signals.
+    double in_flight_ = 0, lag_ms_ = 0, cpu_ = 0, queue_ = 0, rps_ = 0;
+
+    std::atomic<std::int64_t> &spin_;
+    std::atomic<std::int64_t> &score_;
+    std::atomic<std::int64_t> &lag_;
+
+public:
+    explicit load_monitor(boost::asio::io_context &ioc)
+        : timer_(ioc),
+          spin_(metrics_registry::instance().counter(
+              "io_thread_spin_seconds_total", "Time busy-polling I/O threads spent spinning with nothing to do.",
+              "", 1e-6)),
+          score_(metrics_registry::instance().gauge("load_score", "Smoothed load score sent to balancers.", "",
+                                                    0.001)),
+          lag_(metrics_registry::instance().gauge("event_loop_lag_seconds",
+                                                  "Longest wait of ready I/O for its thread at the last tick.", "",
+                                                  1e-9))
+    {
+        cpu_set_t cpus;
+        if (::sched_getaffinity(0, sizeof cpus, &cpus) == 0)
+            cores_ = std::max(CPU_COUNT(&cpus), 1);
+    }
+
+    void watch(boost::asio::io_context &io)
+    {
+        io_ = &io;
+    }
+
+    void watch(const epoll_reactor &reactor)
+    {
+        reactors_.push_back(&reactor);
+    }
+
+    void run()
+    {
+        tick();
+    }
+
+private:
+    // Reactors report how long their current batch has been running. The
+    // shared asio io_context gets a probe handler: the lag is how long the
+    // last one queued, or the one still queued has been waiting.
+    std::int64_t lag_ns()
+    {
+        auto now = tsc_clock::now().time_since_epoch().count();
+        std::int64_t lag = 0;
+        for (auto *r : reactors_)
+            lag = std::max<std::int64_t>(lag, r->lag().count());
+        if (!io_)
+            return lag;
+        if (auto sent = probe_sent_.load())
+            return std::max(lag, now - sent);
+        lag = std::max(lag, probe_lag_.load());
+        probe_sent_ = now;
+        boost::asio::post(*io_, [this, now]
+                          {
+            probe_lag_ = tsc_clock::now().time_since_epoch().count() - now;
+            probe_sent_ = 0; });
+        return lag;
+    }
+
+    void tick()
+    {
+        std::chrono::milliseconds interval, half_life, lag_mark;
+        std::size_t in_flight_mark, queue_mark;
+        std::size_t queued = 0;
+        {
+            rcu_domain::read_guard guard;
+            auto config = active_config().load();
+            auto &settings = config->settings;
+            interval = settings.load_interval;
+            half_life = settings.load_half_life;
+            lag_mark = settings.load_lag;
+            in_flight_mark = settings.load_in_flight;
+            queue_mark = settings.load_queue;
+            for (auto &p : config->pools)
+                queued += p.second->queued();
+            for (auto &r : config->routes)
+                if (r.second->isolation)
+                    queued += r.second->isolation->waiting();
+        }
+
+        auto now = tsc_clock::now();
+        timespec ts;
+        ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        auto cpu = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        auto spin = spin_.load() * 1000; // us
+        auto responses = responses_completed.load();
+        auto lag = lag_ns();
+        lag_ = lag;
+
+        if (primed_)
+        {
+            double wall = static_cast<double>((now - last_tick_).count());
+            double alpha = half_life.count() ? 1 - std::exp2(-wall / (half_life.count() * 1e6)) : 1;
+            auto smooth = [alpha](double &average, double value)
+            { average += alpha * (value - average); };
+            // Busy polling is CPU the thread would give up for work.
+            smooth(cpu_, std::max(0.0, (cpu - last_cpu_ - (spin - last_spin_)) / (wall * cores_)));
+            smooth(rps_, (responses - last_responses_) * 1e9 / wall);
+            smooth(in_flight_, static_cast<double>(requests_in_flight.load()));
+            smooth(lag_ms_, lag / 1e6);
+            smooth(queue_, static_cast<double>(queued));
+        }
+        primed_ = true;
+        last_tick_ = now;
+        last_cpu_ = cpu;
+        last_spin_ = spin;
+        last_responses_ = responses;
+
+        double score = std::max({cpu_, in_flight_ / in_flight_mark, lag_ms_ / lag_mark.count(),
+                                 queue_ / queue_mark});
+        score_ = std::llround(score * 1000);
+        publish(score);
+
+        timer_.expires_after(interval);
+        timer_.async_wait([this](boost::beast::error_code ec)
+                          {
+            if (!ec)
+                tick(); });
+    }
+
+    void publish(double score)
+    {
+        std::ostringstream text, json;
+        text << std::fixed << std::setprecision(3) << "TEXT application_utilization=" << score
+             << ", cpu_utilization=" << cpu_ << ", rps_fractional=" << rps_
+             << ", named_metrics.in_flight=" << in_flight_ << ", named_metrics.loop_lag_ms=" << lag_ms_
+             << ", named_metrics.queue_depth=" << queue_;
+        json << std::fixed << std::setprecision(3) << "{\"application_utilization\":" << score
+             << ",\"cpu_utilization\":" << cpu_ << ",\"rps_fractional\":" << rps_
+             << ",\"named_metrics\":{\"in_flight\":" << in_flight_ << ",\"loop_lag_ms\":" << lag_ms_
+             << ",\"queue_depth\":" << queue_ << "}}\n";
+        current_load().publish(std::make_unique<load_report>(load_report{text.str(), json.str()}));
+    }
+};
+
+// ---------------------------
+// SEND BENCHMARK
+// ---------------------------
+// `./server --bench-sends <file> [rounds]` pushes the file through a loopback
+// TCP connection `rounds` times with each file-send strategy the server has,
+// so the cost of sendfile() and of the io_uring path can be compared on the
+// machine that will run it.
+int bench_sends(const char *path, int rounds)
+{
+    int file = ::open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (file < 0 || ::fstat(file, &st) != 0 || st.st_size == 0)
+        throw std::runtime_error(std::string("bench: cannot read ") + path);
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+
+    int listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0 ||
+        ::listen(listen_fd, 1) != 0 ||
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0)
+        throw std::runtime_error(std::string("bench: ") + std::strerror(errno));
+    int out = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(out, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0)
+        throw std::runtime_error(std::string("bench: ") + std::strerror(errno));
+    int in = ::accept(listen_fd, nullptr, nullptr);
+    ::close(listen_fd);
+
+    // The receiving end only drains, so every strategy sees the same sink.
+    std::thread sink([in]
+                     {
+        std::vector<char> buf(1 << 20);
+        while (::recv(in, buf.data(), buf.size(), 0) > 0)
+        {
+        } });
+
+    auto measure = [&](const char *name, const std::function<void()> &send_once)
+    {
+        send_once(); // warm the page cache and the socket
+        auto start = deadline_clock::now();
+        for (int i = 0; i < rounds; i++)
+            send_once();
+        std::chrono::duration<double> elapsed = deadline_clock::now() - start;
+        std::cout << name << ": " << elapsed.count() * 1e6 / rounds << " us/send, "
+                  << size * rounds / elapsed.count() / (1 << 20) << " MB/s\n";
+    };
+
+    measure("sendfile", [&]
+            {
+        off_t offset = 0;
+        while (static_cast<std::size_t>(offset) < size)
+            if (::sendfile(out, file, &offset, size - offset) <= 0)
+                throw std::runtime_error(std::string("bench: sendfile: ") + std::strerror(errno)); });
+
+    constexpr std::size_t chunk = 256 * 1024;
+    std::unique_ptr<char[]> staging(new char[chunk]);
+    uring ring(8);
+    ring.register_tables(1, 1);
+    if (!ring.set_buffer(0, staging.get(), chunk) || !ring.set_file(0, file))
+        throw std::runtime_error(std::string("bench: io_uring register: ") + std::strerror(errno));
+
+    // One read into the staging buffer and the writes that drain it per
+    // chunk, each submitted and awaited on its own, as the reactor does.
+    auto run = [&](bool fixed)
+    {
+        int result = 0;
+        auto wait_one = [&]
+        {
+            ring.submit(1);
+            ring.reap([&](std::uint64_t, int res)
+                      { result = res; });
+            if (result < 0)
+                throw std::runtime_error(std::string("bench: io_uring: ") + std::strerror(-result));
+            return static_cast<std::size_t>(result);
+        };
+        for (std::size_t offset = 0; offset < size;)
+        {
+            auto *sqe = ring.sqe();
+            sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = fixed ? 0 : file;
+            sqe->flags = fixed ? IOSQE_FIXED_FILE : 0;
+            sqe->addr = reinterpret_cast<std::uintptr_t>(staging.get());
+            sqe->len = static_cast<std::uint32_t>(std::min(chunk, size - offset));
+            sqe->off = offset;
+            auto staged = wait_one();
+            offset += staged;
+            for (std::size_t sent = 0; sent < staged;)
+            {
+                sqe = ring.sqe();
+                sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                sqe->fd = out;
+                sqe->addr = reinterpret_cast<std::uintptr_t>(staging.get() + sent);
+                sqe->len = static_cast<std::uint32_t>(staged - sent);
+                sent += wait_one();
+            }
+        }
+    };
+    measure("io_uring read/write", [&]
+            { run(false); });
+    measure("io_uring fixed file + buffer", [&]
+            { run(true); });
+
+    ::shutdown(out, SHUT_WR);
+    sink.join();
+    ::close(in);
+    ::close(out);
+    ::close(file);
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
-    const int PORT = 8090;
-    const int THREADS = std::thread::hardware_concurrency();
+    if (argc > 2 && std::string(argv[1]) == "--bench-sends")
+    {
+        try
+        {
+            return bench_sends(argv[2], argc > 3 ? std::stoi(argv[3]) : 200);
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << "Fatal Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    // The config file is optional; without one the server keeps serving the
+    // default /hello and /headers routes on port 8090.
+    const std::string config_path = argc > 1 ? argv[1] : "server.conf";
 
     try
     {
+        if (std::ifstream(config_path))
+        {
+            active_config().publish(load_config(config_path));
+            std::cout << "Config: " << config_path << "\n";
+        }
+
+        server_settings settings;
+        {
+            rcu_domain::read_guard guard;
+            settings = active_config().load()->settings;
+        }
+        apply_settings(settings);
+        const int PORT = settings.port;
+        const int THREADS = settings.threads > 0 ? settings.threads
+                                                 : std::thread::hardware_concurrency();
+
+        // Background work (config reloads, memory pressure sampling, the
+        // shared-memory metrics) runs on a housekeeping thread of its own so
+        // it never competes with request handling on the I/O threads.
+        boost::asio::io_context housekeeping;
+        auto housekeeping_work = boost::asio::make_work_guard(housekeeping);
+        config_reloader reloader(housekeeping, config_path);
+        reloader.run();
+        pressure_monitor monitor(housekeeping);
+        monitor.run();
+        metrics_publisher publisher(housekeeping);
+        publisher.run();
+
         // io_context object with a specified number of threads
         boost::asio::io_context ioc;
 
@@ -179,8 +5948,40 @@ int main()
         // connections. The run() method initiates the asynchronous acceptance of
         // new connections by calling acceptor_.async_accept, which triggers the
         // on_accept callback when a connection arrives.
-        std::make_shared<listener>(ioc, endp)
-            ->run();
+        // The reactor backends bind one SO_REUSEPORT listener per thread instead.
+        std::vector<std::unique_ptr<epoll_reactor>> reactors;
+        if (settings.backend != io_backend::asio)
+        {
+            for (int i = 0; i < THREADS; i++)
+                reactors.push_back(std::make_unique<epoll_reactor>(PORT, settings.backend == io_backend::uring));
+        }
+        else
+            std::make_shared<listener>(ioc, endp)
+                ->run();
+
+        load_monitor load(housekeeping);
+        if (reactors.empty())
+            load.watch(ioc);
+        for (auto &r : reactors)
+            load.watch(*r);
+        load.run();
+
+        // Started only now that the port is bound, and stopped and joined
+        // however this scope is left, so a throw below still reaches the
+        // Fatal Error handler instead of std::terminate.
+        std::thread housekeeping_thread([&housekeeping]
+                                        { housekeeping.run(); });
+        struct housekeeping_joiner
+        {
+            boost::asio::io_context &ioc;
+            std::thread &thread;
+
+            ~housekeeping_joiner()
+            {
+                ioc.stop();
+                thread.join();
+            }
+        } joiner{housekeeping, housekeeping_thread};
 
         // A common pattern used when implementing a thread pool in C++ to
         // pre-allocate space for a specified number of threads.
@@ -195,12 +5996,29 @@ int main()
         pool.reserve(THREADS);
 
         std::cout << "Server running on http://localhost:" << PORT << "\n";
-        std::cout << "Threads: " << THREADS << "\n";
+        std::cout << "Clock: " << tsc_clock::source() << "\n";
+        if (!tcp_byte_counts_available())
+            std::cerr << "slow clients: no TCP byte counters in TCP_INFO, min_data_rate not enforced\n";
+        std::cout << "Threads: " << THREADS
+                  << (settings.backend == io_backend::epoll   ? " (epoll)"
+                      : settings.backend == io_backend::uring ? " (epoll + io_uring)"
+                                                              : "")
+                  << "\n";
 
         // In practice, after reserving space, threads are typically created using emplace_back to construct them in place within the vector, passing a lambda or function object that defines the thread's behavior, such as polling a work queue for tasks.
         for (int i = 0; i < THREADS; i++)
-            pool.emplace_back([&ioc]
-                              { ioc.run(); });
+        {
+            if (settings.backend != io_backend::asio)
+                pool.emplace_back([i, reactor = reactors[i].get(), spin = settings.busy_poll]
+                                  {
+                    enroll_io_thread(i);
+                    reactor->run(spin); });
+            else
+                pool.emplace_back([i, &ioc, spin = settings.busy_poll]
+                                  {
+                    enroll_io_thread(i);
+                    run_io_thread(ioc, spin); });
+        }
 
         // waiting for all worker threads to finish.
         // blocks the current thread of execution until the thread it is called
@@ -227,4 +6045,4 @@ int main()
     {
         std::cerr << "Fatal Error: " << e.what() << "\n";
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,50 @@
+/*
+ * Layout of the shared-memory metrics segment the server publishes when
+ * server.conf has `metrics_shm <name>`, and that metricsctl reads.
+ *
+ * The segment (shm_open(name), usually /dev/shm/<name>) is a header followed
+ * by `capacity` bytes of payload. The payload holds `length` bytes of the
+ * Prometheus text exposition, exactly what /metrics would answer at
+ * `published_ns`. The server rewrites it every publish interval from its
+ * housekeeping thread, so reading it never touches the HTTP port or the I/O
+ * threads.
+ *
+ * Snapshots are guarded by a seqlock. The writer makes `sequence` odd,
+ * rewrites length, published_ns and the payload, then makes it even again.
+ * A reader loads `sequence` (acquire) and retries while it is odd. It then
+ * copies length and payload, issues an acquire fence and loads `sequence`
+ * again. The copy is good if both loads agree. Use the GCC __atomic builtins
+ * (or C11/C++ atomics) on `sequence`.
+ *
+ * Later versions only append header fields; readers find the payload at
+ * `header_size` and ignore fields they do not know.
+ */
+#ifndef METRICS_SHM_H
+#define METRICS_SHM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_SHM_MAGIC "HTTPMSHM" /* 8 bytes, no terminator */
+#define METRICS_SHM_VERSION 1
+
+typedef struct metrics_shm_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;  /* offset of the payload from the segment start */
+    uint64_t capacity;     /* payload bytes available */
+    uint64_t sequence;     /* seqlock: odd while a snapshot is written */
+    uint64_t length;       /* payload bytes of the current snapshot */
+    uint64_t published_ns; /* CLOCK_REALTIME when the snapshot was taken */
+    uint64_t publisher_pid;
+} metrics_shm_header;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_SHM_H */
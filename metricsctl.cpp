@@ -0,0 +1,223 @@
+/*g++ -std=c++17 -O2 metricsctl.cpp -o metricsctl*/
+// Reads the shared-memory metrics segment a server publishes with
+// `metrics_shm` in server.conf (layout in metrics_shm.h).
+//
+//   metricsctl print <segment> [--watch SECONDS]
+//   metricsctl serve <segment> [--port P]
+//
+// print writes the latest snapshot to stdout (again every SECONDS with
+// --watch). serve answers every HTTP request on --port (default 9091) with
+// the latest snapshot, so Prometheus can scrape a server whose own port is
+// saturated. Neither ever talks to the server; the snapshot age goes to
+// stderr, or to the X-Snapshot-Age-Ms header when serving.
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "metrics_shm.h"
+
+// ---------------------------
+// SEGMENT
+// ---------------------------
+struct snapshot
+{
+    std::string text;
+    std::uint64_t published_ns = 0;
+    std::uint64_t pid = 0;
+};
+
+// Maps the segment for the duration of one read, so a server restart (which
+// recreates it) is picked up by the next read.
+snapshot read_snapshot(const std::string &name)
+{
+    int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error("cannot open " + name + ": " + std::strerror(errno) +
+                                 " (is metrics_shm set in server.conf?)");
+    struct stat st;
+    void *at = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(metrics_shm_header))
+        at = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (at == MAP_FAILED)
+        throw std::runtime_error(name + " is not a metrics segment");
+
+    auto size = static_cast<std::size_t>(st.st_size);
+    auto *header = static_cast<const metrics_shm_header *>(at);
+    auto unmap = [&]
+    { ::munmap(at, size); };
+    if (std::memcmp(header->magic, METRICS_SHM_MAGIC, sizeof header->magic) != 0 || header->version < 1 ||
+        header->header_size < sizeof(metrics_shm_header) || header->header_size > size)
+    {
+        unmap();
+        throw std::runtime_error(name + " is not a metrics segment");
+    }
+
+    const char *payload = static_cast<const char *>(at) + header->header_size;
+    auto room = size - header->header_size;
+    snapshot s;
+    for (int attempt = 0; attempt < 10000; attempt++)
+    {
+        auto before = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            ::sched_yield(); // mid-publish
+            continue;
+        }
+        auto length = std::min<std::uint64_t>(header->length, room);
+        s.text.assign(payload, length);
+        s.published_ns = header->published_ns;
+        s.pid = header->publisher_pid;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) == before)
+        {
+            unmap();
+            if (before == 0)
+                throw std::runtime_error(name + " has no snapshot yet");
+            return s;
+        }
+    }
+    unmap();
+    throw std::runtime_error("no consistent snapshot in " + name);
+}
+
+std::int64_t age_ms(const snapshot &s)
+{
+    timespec now;
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    auto now_ns = static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    return (now_ns - static_cast<std::int64_t>(s.published_ns)) / 1000000;
+}
+
+// ---------------------------
+// MODES
+// ---------------------------
+void print(const std::string &name, int watch)
+{
+    for (;;)
+    {
+        auto s = read_snapshot(name);
+        std::cerr << "# " << name << ": pid " << s.pid << ", " << age_ms(s) << " ms old\n";
+        std::cout << s.text << std::flush;
+        if (watch <= 0)
+            return;
+        std::this_thread::sleep_for(std::chrono::seconds(watch));
+    }
+}
+
+// One request per connection, answered in order; scrapers need no more.
+void serve(const std::string &name, int port)
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0 ||
+        ::listen(listener, 64) != 0)
+        throw std::runtime_error("cannot listen on port " + std::to_string(port) + ": " + std::strerror(errno));
+    std::cout << "serving " << name << " on port " << port << "\n";
+
+    for (;;)
+    {
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        timeval timeout{2, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+        // Read up to the end of the request head; the target is ignored.
+        std::string head;
+        char buf[4096];
+        while (head.find("\r\n\r\n") == std::string::npos && head.size() < 65536)
+        {
+            auto n = ::recv(fd, buf, sizeof buf, 0);
+            if (n <= 0)
+                break;
+            head.append(buf, n);
+        }
+
+        std::string status = "200 OK", body, extra;
+        try
+        {
+            auto s = read_snapshot(name);
+            body = std::move(s.text);
+            extra = "X-Snapshot-Age-Ms: " + std::to_string(age_ms(s)) + "\r\n";
+        }
+        catch (std::exception &e)
+        {
+            status = "503 Service Unavailable";
+            body = std::string(e.what()) + "\n";
+        }
+        auto response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\n" + extra +
+                        "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        for (std::size_t sent = 0; sent < response.size();)
+        {
+            auto n = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+        ::close(fd);
+    }
+}
+
+int usage()
+{
+    std::cerr << "usage: metricsctl print <segment> [--watch SECONDS]\n"
+                 "       metricsctl serve <segment> [--port P]\n";
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string mode = argc >= 3 ? argv[1] : "";
+    if (mode != "print" && mode != "serve")
+        return usage();
+
+    std::string name = argv[2];
+    if (name[0] != '/')
+        name = "/" + name; // as the server names it
+    int watch = 0, port = 9091;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return usage();
+        std::string value = argv[++i];
+        if (arg == "--watch" && mode == "print")
+            watch = std::stoi(value);
+        else if (arg == "--port" && mode == "serve")
+            port = std::stoi(value);
+        else
+            return usage();
+    }
+
+    try
+    {
+        if (mode == "print")
+            print(name, watch);
+        else
+            serve(name, port);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Fatal Error: " << e.what() << "\n";
+        return 1;
+    }
+}
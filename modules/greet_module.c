@@ -0,0 +1,65 @@
+/*gcc -shared -fPIC -O2 -I.. greet_module.c -o greet_module.so*/
+/*
+ * Example handler module. Load it with
+ *
+ *     module greet modules/greet_module.so
+ *     route /greet greet.hello
+ *
+ * The request counter lives in module state, so it survives config reloads
+ * as long as the .so file is unchanged.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "http_module.h"
+
+typedef struct greet_state
+{
+    const http_module_host *host;
+    unsigned long served; /* updated with __atomic builtins, handlers run concurrently */
+} greet_state;
+
+static int hello(void *user_data, const http_module_request *req, http_module_response *res)
+{
+    greet_state *state = (greet_state *)user_data;
+    unsigned long n = __atomic_add_fetch(&state->served, 1, __ATOMIC_RELAXED);
+
+    char body[256];
+    int len = snprintf(body, sizeof body, "hello from greet_module, %.*s #%lu\n",
+                       (int)req->target.size, req->target.data, n);
+    if (len < 0)
+        return -1;
+    if ((size_t)len >= sizeof body)
+        len = sizeof body - 1;
+
+    state->host->set_status(res, 200);
+    state->host->set_header(res, "Content-Type", 12, "text/plain", 10);
+    state->host->append_body(res, body, (size_t)len);
+    return 0;
+}
+
+uint32_t http_module_abi(void)
+{
+    return HTTP_MODULE_ABI_VERSION;
+}
+
+int http_module_init(const http_module_host *host, http_module_registrar *registrar, void **module_state)
+{
+    greet_state *state = calloc(1, sizeof *state);
+    if (!state)
+        return -1;
+    state->host = host;
+
+    if (host->add_handler(registrar, "hello", hello, state) != 0)
+    {
+        free(state);
+        return -1;
+    }
+    *module_state = state;
+    return 0;
+}
+
+void http_module_fini(void *module_state)
+{
+    free(module_state);
+}